@@ -0,0 +1,302 @@
+/*
+ * Benchmark suite for BlockChainNetworkSim.
+ */
+
+#include "ns3/core-module.h"
+#include "BlockChainProcess.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <chrono>
+#include <filesystem>
+#include <climits>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Runs a fixed matrix of simulations one after the other and records how
+// expensive each one was:
+// topologies 1-9 and generated topologies of 100, 1000 and 5000 nodes,
+// each with TCP and UDP, with and without compact blocks.
+//
+// example: ./ns3 run "scratch/BlockChainBenchmark --baseline=benchmarkbaseline.csv"
+// or:      ./ns3 build blockchain-benchmark
+//
+// Runs are serial so they do not compete for cores or memory bandwidth.
+// Every run uses the same seed, so a case simulates the same thing each time.
+//
+// BCSBCBenchmark/
+// |  topology1-tcp-compact/  // Working directory of the case, as in BlockChainSweep
+// |  ...
+// |  - results.csv           // One row per case
+//
+// To keep a baseline, copy results.csv somewhere and pass it with --baseline
+// on later runs. Cases whose wall time or peak memory grew by more than
+// --tolerance are reported as regressions.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("BlockChainBenchmark");
+
+/**
+ * One simulation in the benchmark matrix
+ */
+struct BenchmarkCase {
+  std::string name;
+  std::vector<std::string> args;
+  int exitStatus = -1;
+  double wallTime = 0;
+  long peakMemoryKb = 0;
+  uint64_t events = 0;
+  double eventsPerSecond = 0;
+  uint64_t outputBytes = 0;
+};
+
+/**
+ * Build the benchmark matrix
+ *
+ * \param minConnections The minimum connections per node of the generated topologies
+ *
+ * \return the cases, in the order they are run
+ */
+std::vector<BenchmarkCase> benchmarkMatrix (int minConnections) {
+  std::vector<std::pair<std::string, std::vector<std::string>>> topologies;
+  for (int topology = 1; topology <= 9; topology++) {
+      topologies.push_back(std::make_pair("topology" + std::to_string(topology),
+                                          std::vector<std::string> {"--topology=" + std::to_string(topology)}));
+  }
+  // Global routing keeps a route to every interface at every node, which
+  // for thousands of nodes costs more than the simulation being measured,
+  // so the generated topologies only route their bcConnections
+  for (int nodes : {100, 1000, 5000}) {
+      topologies.push_back(std::make_pair("generated" + std::to_string(nodes),
+                                          std::vector<std::string> {"--nodes=" + std::to_string(nodes),
+                                                                    "--minConnectionsPerNode=" + std::to_string(minConnections),
+                                                                    "--routing=peer"}));
+  }
+
+  std::vector<BenchmarkCase> cases;
+  for (const auto &topology : topologies) {
+      for (std::string protocol : {"TCP", "UDP"}) {
+          for (int compactBlocks : {1, 0}) {
+              BenchmarkCase benchmarkCase;
+              benchmarkCase.name = topology.first + (protocol == "TCP" ? "-tcp" : "-udp")
+                                   + (compactBlocks ? "-compact" : "-full");
+              benchmarkCase.args = topology.second;
+              benchmarkCase.args.push_back("--protocol=" + protocol);
+              benchmarkCase.args.push_back("--compactBlocks=" + std::to_string(compactBlocks));
+              cases.push_back(benchmarkCase);
+          }
+      }
+  }
+  return cases;
+}
+
+/**
+ * Run one case to completion in its own directory
+ *
+ * \param benchmarkCase The case, its measurements are filled in
+ * \param directory The working directory of the case
+ * \param simulator The absolute path of the simulator executable
+ * \param fixedArgs Arguments passed to every case
+ */
+void runCase (BenchmarkCase &benchmarkCase, const std::string &directory,
+    const std::string &simulator, const std::vector<std::string> &fixedArgs) {
+  std::filesystem::remove_all(directory);
+
+  std::vector<std::string> args;
+  args.push_back(simulator);
+  args.insert(args.end(), fixedArgs.begin(), fixedArgs.end());
+  args.insert(args.end(), benchmarkCase.args.begin(), benchmarkCase.args.end());
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = startSimulatorProcess(directory, args);
+  if (pid < 0) {
+      return;
+  }
+
+  // wait4 gives the resource usage of this child alone
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+      return;
+  }
+  benchmarkCase.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  benchmarkCase.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  benchmarkCase.peakMemoryKb = usage.ru_maxrss;
+
+  // "Simulated <events> events in <seconds>s (<rate> events per second)"
+  std::ifstream output (directory + "/stdout.txt");
+  std::string line;
+  while (std::getline(output, line)) {
+      if (line.compare(0, 10, "Simulated ") != 0) {
+          continue;
+      }
+      std::vector<std::string> words = splitNonEmpty(line, ' ');
+      if (words.size() >= 6) {
+          try {
+              benchmarkCase.events = std::stoull(words[1]);
+              benchmarkCase.eventsPerSecond = std::stod(words[5].substr(1));
+          } catch (const std::exception& e) {
+          }
+      }
+  }
+
+  std::error_code error;
+  for (const auto &entry : std::filesystem::recursive_directory_iterator(directory + "/BCSBCOutput", error)) {
+      if (entry.is_regular_file(error)) {
+          benchmarkCase.outputBytes += entry.file_size(error);
+      }
+  }
+}
+
+/**
+ * Read a results file written by an earlier benchmark
+ *
+ * \param fileName The results file
+ * \param baseline Filled with the cases, by name
+ *
+ * \return false if the file could not be read
+ */
+bool readBaseline (const std::string &fileName, std::map<std::string, BenchmarkCase> &baseline) {
+  std::ifstream file (fileName);
+  if (!file.is_open()) {
+      return false;
+  }
+  std::string line;
+  std::getline(file, line); // header
+  while (std::getline(file, line)) {
+      std::vector<std::string> fields = splitNonEmpty(line, ',');
+      if (fields.size() < 7) {
+          continue;
+      }
+      BenchmarkCase benchmarkCase;
+      try {
+          benchmarkCase.name = fields[0];
+          benchmarkCase.exitStatus = std::stoi(fields[1]);
+          benchmarkCase.wallTime = std::stod(fields[2]);
+          benchmarkCase.peakMemoryKb = std::stol(fields[3]);
+          benchmarkCase.events = std::stoull(fields[4]);
+          benchmarkCase.eventsPerSecond = std::stod(fields[5]);
+          benchmarkCase.outputBytes = std::stoull(fields[6]);
+      } catch (const std::exception& e) {
+          continue;
+      }
+      baseline[benchmarkCase.name] = benchmarkCase;
+  }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+
+  int endTime = 200;
+  int minConnections = 8;
+  std::string cases = "";
+  std::string fixed = "";
+  std::string outputDir = "BCSBCBenchmark";
+  std::string baselineFile = "";
+  double tolerance = 0.2;
+  std::string simulator = "";
+
+  cmd.AddValue("endTime", "\nThe simulation end time of every case in seconds.\nExample: 500.\nDefault: 200.\n", endTime);
+  cmd.AddValue("minConnections", "\nThe minimum connections per node of the generated topologies.\nExample: 4.\nDefault: 8.\n", minConnections);
+  cmd.AddValue("cases", "\nOnly run the cases whose name contains this.\nCases are named <topology>-<tcp|udp>-<compact|full>, e.g. topology4-udp-full, generated1000-tcp-compact.\nExample: 'generated'.\nDefault: None. Run every case.\n", cases);
+  cmd.AddValue("fixed", "\nArguments passed unchanged to every case. Space separated.\nExample: '--routing=peer'.\nDefault: None.\n", fixed);
+  cmd.AddValue("outputDir", "\nThe directory the cases and results are written to.\nExample: 'bench1'.\nDefault: 'BCSBCBenchmark'.\n", outputDir);
+  cmd.AddValue("baseline", "\nA results.csv from an earlier benchmark to compare against.\nExample: 'benchmarkbaseline.csv'.\nDefault: None. No comparison.\n", baselineFile);
+  cmd.AddValue("tolerance", "\nThe fraction wall time or peak memory may grow over the baseline before it is a regression.\nExample: 0.1.\nDefault: 0.2.\n", tolerance);
+  cmd.AddValue("simulator", "\nPath of the BlockChainNetworkSim executable.\nExample: 'build/scratch/ns3.40-BlockChainNetworkSim-default'.\nDefault: Found next to this executable.\n", simulator);
+
+  cmd.Parse (argc, argv);
+
+  LogComponentEnable ("BlockChainBenchmark", LOG_LEVEL_INFO);
+
+  if (simulator == "") {
+      simulator = siblingExecutablePath(argv[0], "BlockChainBenchmark", "BlockChainNetworkSim");
+  }
+  if (simulator == "" || access(simulator.c_str(), X_OK) != 0) {
+      NS_LOG_INFO ("Could not find the BlockChainNetworkSim executable, specify it with --simulator");
+      return 1;
+  }
+  char resolved[PATH_MAX];
+  if (realpath(simulator.c_str(), resolved) != nullptr) {
+      simulator = resolved; // cases change directory before exec
+  }
+
+  std::map<std::string, BenchmarkCase> baseline;
+  if (baselineFile != "" && !readBaseline(baselineFile, baseline)) {
+      NS_LOG_INFO ("Could not read the baseline " + baselineFile);
+      return 1;
+  }
+
+  std::vector<std::string> fixedArgs = splitNonEmpty(fixed, ' ');
+  fixedArgs.push_back("--endTime=" + std::to_string(endTime));
+  fixedArgs.push_back("--seed=1");
+  fixedArgs.push_back("--run=1");
+
+  std::vector<BenchmarkCase> matrix;
+  for (const BenchmarkCase &benchmarkCase : benchmarkMatrix(minConnections)) {
+      if (benchmarkCase.name.find(cases) != std::string::npos) {
+          matrix.push_back(benchmarkCase);
+      }
+  }
+
+  std::cout << "Running " << matrix.size() << " benchmark cases" << std::endl;
+  std::filesystem::create_directories(outputDir);
+  int failed = 0;
+  int regressions = 0;
+  int numberOfCases = (int) matrix.size();
+  int c = 0;
+  while (c < numberOfCases) {
+      BenchmarkCase &benchmarkCase = matrix[c];
+      runCase(benchmarkCase, outputDir + "/" + benchmarkCase.name, simulator, fixedArgs);
+      if (benchmarkCase.exitStatus != 0) {
+          failed++;
+      }
+      std::cout << "[" << c + 1 << "/" << matrix.size() << "] " << benchmarkCase.name
+                << ": exit " << benchmarkCase.exitStatus
+                << ", " << benchmarkCase.wallTime << "s"
+                << ", " << benchmarkCase.peakMemoryKb / 1024 << "MB"
+                << ", " << benchmarkCase.eventsPerSecond << " events/s"
+                << ", " << benchmarkCase.outputBytes << " output bytes";
+
+      auto previous = baseline.find(benchmarkCase.name);
+      if (previous != baseline.end() && previous->second.wallTime > 0 && previous->second.peakMemoryKb > 0) {
+          double timeRatio = benchmarkCase.wallTime / previous->second.wallTime;
+          double memoryRatio = (double) benchmarkCase.peakMemoryKb / previous->second.peakMemoryKb;
+          std::cout << ", time x" << timeRatio << ", memory x" << memoryRatio;
+          if (benchmarkCase.exitStatus == 0 && (timeRatio > 1 + tolerance || memoryRatio > 1 + tolerance)) {
+              std::cout << " REGRESSION";
+              regressions++;
+          }
+      }
+      std::cout << std::endl;
+      c++;
+  }
+
+  std::ofstream results (outputDir + "/results.csv");
+  results << "Case,Exit status,Wall time (s),Peak memory (KB),Events,Events per second,Output bytes\n";
+  for (const BenchmarkCase &benchmarkCase : matrix) {
+      results << benchmarkCase.name
+              << "," << benchmarkCase.exitStatus
+              << "," << benchmarkCase.wallTime
+              << "," << benchmarkCase.peakMemoryKb
+              << "," << benchmarkCase.events
+              << "," << benchmarkCase.eventsPerSecond
+              << "," << benchmarkCase.outputBytes << "\n";
+  }
+  results.close();
+
+  std::cout << "Benchmark complete, " << failed << " of " << matrix.size() << " cases failed";
+  if (baselineFile != "") {
+      std::cout << ", " << regressions << " regressions against " << baselineFile;
+  }
+  std::cout << std::endl;
+  std::cout << "Results written to " << outputDir << "/results.csv" << std::endl;
+
+  return (failed == 0 && regressions == 0) ? 0 : 1;
+}
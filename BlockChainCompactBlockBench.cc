@@ -0,0 +1,305 @@
+/*
+ * Compact block reconstruction micro-benchmark.
+ */
+
+#include "ns3/core-module.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+
+// Measures BIP152 compact block reconstruction against a receiver's
+// transaction pool for a range of pool sizes, and the bytes a compact block
+// saves over sending the full block.
+//
+// example: ./ns3 run "scratch/BlockChainCompactBlockBench --mempoolSizes=5000,20000,100000 --transactionsBlock=2000"
+//
+// Short transaction IDs are salted per block, so a transaction pool cannot
+// keep a persistent index of them. Two ways of matching are compared:
+// scan:    for every short ID in the block, scan the pool (block x pool)
+// indexed: put the block's short IDs in a hash index, then compute the short
+//          ID of every pool transaction once and look it up (block + pool),
+//          as Bitcoin Core does
+// Missing transactions are requested in one batched getblocktxn message.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("BlockChainCompactBlockBench");
+
+/**
+ * A 256 bit transaction id
+ */
+struct TransactionId {
+  uint64_t words[4];
+};
+
+#define SIPROUND do { \
+    v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+    v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+    v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+    v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+} while (0)
+
+/**
+ * SipHash-2-4 of a 256 bit id (as SipHashUint256 in Bitcoin Core)
+ *
+ * \param k0 The first half of the key
+ * \param k1 The second half of the key
+ * \param id The id to hash
+ *
+ * \return the 64 bit hash
+ */
+uint64_t sipHash (uint64_t k0, uint64_t k1, const TransactionId &id) {
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ k1;
+  for (int i = 0; i < 4; i++) {
+      uint64_t d = id.words[i];
+      v3 ^= d;
+      SIPROUND;
+      SIPROUND;
+      v0 ^= d;
+  }
+  uint64_t length = ((uint64_t) 32) << 56; // message length in the top byte
+  v3 ^= length;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= length;
+  v2 ^= 0xFF;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * The 6 byte short id of a transaction
+ */
+uint64_t shortId (uint64_t k0, uint64_t k1, const TransactionId &id) {
+  return sipHash(k0, k1, id) & 0xffffffffffffULL;
+}
+
+/**
+ * The size of a bitcoin CompactSize integer
+ */
+int compactSizeBytes (uint64_t value) {
+  if (value < 253) {
+      return 1;
+  }
+  if (value <= 0xffff) {
+      return 3;
+  }
+  if (value <= 0xffffffff) {
+      return 5;
+  }
+  return 9;
+}
+
+/**
+ * The result of reconstructing one block
+ */
+struct Reconstruction {
+  int found = 0;
+  int missing = 0;
+  int collisions = 0;
+};
+
+/**
+ * Match the block's short ids by scanning the pool for each of them
+ */
+Reconstruction reconstructByScan (const std::vector<uint64_t> &blockShortIds,
+    const std::vector<TransactionId> &mempool, uint64_t k0, uint64_t k1) {
+  Reconstruction result;
+  for (uint64_t id : blockShortIds) {
+      int matches = 0;
+      for (const TransactionId &transaction : mempool) {
+          if (shortId(k0, k1, transaction) == id) {
+              matches++;
+          }
+      }
+      if (matches == 1) {
+          result.found++;
+      } else {
+          result.missing++;
+          if (matches > 1) {
+              result.collisions++;
+          }
+      }
+  }
+  return result;
+}
+
+/**
+ * Match the block's short ids with one pass over the pool,
+ * looking each pool transaction up in an index of the block
+ */
+Reconstruction reconstructByIndex (const std::vector<uint64_t> &blockShortIds,
+    const std::vector<TransactionId> &mempool, uint64_t k0, uint64_t k1) {
+  Reconstruction result;
+  // short id to position in the block
+  std::unordered_map<uint64_t, uint32_t> index;
+  index.reserve(blockShortIds.size());
+  for (uint32_t i = 0; i < blockShortIds.size(); i++) {
+      index.emplace(blockShortIds[i], i);
+  }
+  std::vector<int> matches (blockShortIds.size(), 0);
+  for (const TransactionId &transaction : mempool) {
+      auto it = index.find(shortId(k0, k1, transaction));
+      if (it != index.end()) {
+          matches[it->second]++;
+      }
+  }
+  for (int count : matches) {
+      if (count == 1) {
+          result.found++;
+      } else {
+          result.missing++;
+          if (count > 1) {
+              result.collisions++;
+          }
+      }
+  }
+  return result;
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+
+  std::string mempoolSizes = "5000,20000,100000";
+  int transactionsBlock = 2000;
+  int transactionSize = 250;
+  double missingFraction = 0.02;
+  int repetitions = 20;
+  int maxScanMempool = 20000;
+  uint32_t seed = 1;
+
+  cmd.AddValue("mempoolSizes", "\nThe transaction pool sizes to measure. Comma separated.\nExample: '500,5000'.\nDefault: '5000,20000,100000'.\n", mempoolSizes);
+  cmd.AddValue("transactionsBlock", "\nThe number of transactions in a block.\nExample: 500.\nDefault: 2000.\n", transactionsBlock);
+  cmd.AddValue("transactionSize", "\nThe transaction size in bytes.\nExample: 100.\nDefault: 250.\n", transactionSize);
+  cmd.AddValue("missingFraction", "\nThe fraction of the block's transactions missing from the receiver's pool.\nExample: 0.1.\nDefault: 0.02.\n", missingFraction);
+  cmd.AddValue("repetitions", "\nThe number of blocks reconstructed per pool size.\nExample: 100.\nDefault: 20.\n", repetitions);
+  cmd.AddValue("maxScanMempool", "\nThe largest pool size the scan method is measured for (it is block x pool).\nExample: 0 to skip it.\nDefault: 20000.\n", maxScanMempool);
+  cmd.AddValue("seed", "\nThe random seed.\nExample: 7.\nDefault: 1.\n", seed);
+
+  cmd.Parse (argc, argv);
+
+  if (transactionsBlock < 1 || transactionSize < 1 || repetitions < 1 || missingFraction < 0 || missingFraction > 1) {
+      NS_LOG_UNCOND ("Invalid benchmark parameters");
+      return 1;
+  }
+
+  std::vector<int> sizes;
+  std::stringstream sizeStream (mempoolSizes);
+  std::string size;
+  while (std::getline(sizeStream, size, ',')) {
+      int mempoolSize = 0;
+      try {
+          mempoolSize = std::stoi(size);
+      } catch (const std::exception& e) {
+          NS_LOG_UNCOND ("Invalid mempool size " << size << ", it must be a whole number up to " << INT_MAX);
+          return 1;
+      }
+      if (mempoolSize < 0) {
+          NS_LOG_UNCOND ("Invalid mempool size " << size << ", it cannot be negative");
+          return 1;
+      }
+      sizes.push_back(mempoolSize);
+  }
+
+  std::mt19937_64 rng (seed);
+  auto randomId = [&rng] () {
+      TransactionId id;
+      for (int i = 0; i < 4; i++) {
+          id.words[i] = rng();
+      }
+      return id;
+  };
+
+  // Bytes on the wire, as in BIP152. Every message has a 24 byte header.
+  // The coinbase is always prefilled.
+  const int messageHeader = 24;
+  const int blockHeader = 80;
+  int shortIds = transactionsBlock - 1;
+  int missing = (int) (missingFraction * shortIds);
+  long fullBlockBytes = messageHeader + blockHeader + compactSizeBytes(transactionsBlock) + (long) transactionsBlock * transactionSize;
+  long compactBlockBytes = messageHeader + blockHeader + 8 + compactSizeBytes(shortIds) + 6L * shortIds
+                           + compactSizeBytes(1) + compactSizeBytes(0) + transactionSize;
+  if (missing > 0) {
+      // one getblocktxn with differentially encoded indexes (mostly 1 byte each)
+      // and one blocktxn with the transactions
+      compactBlockBytes += messageHeader + 32 + compactSizeBytes(missing) + missing;
+      compactBlockBytes += messageHeader + 32 + compactSizeBytes(missing) + (long) missing * transactionSize;
+  }
+
+  std::cout << "Block of " << transactionsBlock << " transactions of " << transactionSize << " bytes, "
+            << missing << " missing from the receiver's pool" << std::endl;
+  std::cout << "Full block " << fullBlockBytes << " bytes, compact block " << compactBlockBytes << " bytes, saves "
+            << (fullBlockBytes - compactBlockBytes) << " bytes ("
+            << 100.0 * (fullBlockBytes - compactBlockBytes) / fullBlockBytes << "%)" << std::endl;
+  std::cout << "Pool size,Method,Microseconds per block,Found,Missing,Collisions" << std::endl;
+
+  for (int mempoolSize : sizes) {
+      if (mempoolSize < shortIds - missing) {
+          NS_LOG_UNCOND ("Pool size " << mempoolSize << " is smaller than the transactions it must hold");
+          return 1;
+      }
+      for (int method = 0; method < 2; method++) {
+          bool scan = (method == 0);
+          if (scan && mempoolSize > maxScanMempool) {
+              continue;
+          }
+          double totalMicroseconds = 0;
+          Reconstruction last;
+          for (int r = 0; r < repetitions; r++) {
+              // the pool holds the block's transactions that are not missing, plus others
+              std::vector<TransactionId> mempool;
+              mempool.reserve(mempoolSize);
+              std::vector<TransactionId> block;
+              block.reserve(shortIds);
+              for (int t = 0; t < shortIds; t++) {
+                  block.push_back(randomId());
+                  if (t >= missing) {
+                      mempool.push_back(block.back());
+                  }
+              }
+              while ((int) mempool.size() < mempoolSize) {
+                  mempool.push_back(randomId());
+              }
+              std::shuffle(mempool.begin(), mempool.end(), rng);
+
+              // BIP152 derives the keys from SHA256(header || nonce)
+              uint64_t k0 = rng();
+              uint64_t k1 = rng();
+              std::vector<uint64_t> blockShortIds;
+              blockShortIds.reserve(shortIds);
+              for (const TransactionId &transaction : block) {
+                  blockShortIds.push_back(shortId(k0, k1, transaction));
+              }
+
+              auto start = std::chrono::steady_clock::now();
+              last = scan ? reconstructByScan(blockShortIds, mempool, k0, k1)
+                          : reconstructByIndex(blockShortIds, mempool, k0, k1);
+              totalMicroseconds += std::chrono::duration<double, std::micro> (std::chrono::steady_clock::now() - start).count();
+              if (scan) {
+                  break; // too slow to repeat
+              }
+          }
+          int measured = scan ? 1 : repetitions;
+          std::cout << mempoolSize << "," << (scan ? "scan" : "indexed") << ","
+                    << totalMicroseconds / measured << "," << last.found << ","
+                    << last.missing << "," << last.collisions << std::endl;
+      }
+  }
+
+  return 0;
+}
@@ -15,10 +15,24 @@
 #include "ns3/testblockpool.h"
 #include "ns3/testblockchain.h"
 #include "ns3/testtransactionpool.h"
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#endif
+#include "BlockChainProfile.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <map>
 #include <random>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <sys/resource.h>
 
 // Default topology:
 // n0-----n1
@@ -109,6 +123,1361 @@ void cleanOutputFiles() {
   
 }
 
+/**
+ * The wall clock time since a point in time
+ *
+ * \param start The point in time
+ *
+ * \return the number of seconds since start
+ */
+double secondsSince (std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * The largest resident set size of this process so far
+ *
+ * \return the peak resident memory in kilobytes
+ */
+long peakMemoryKb () {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return 0;
+  }
+  return usage.ru_maxrss; // kilobytes on Linux
+}
+
+#ifdef NS3_MPI
+/**
+ * Disables MPI when it goes out of scope, so MPI is finalized
+ * on every return from main after MpiInterface::Enable
+ */
+struct MpiGuard {
+  ~MpiGuard () {
+    MpiInterface::Disable ();
+  }
+};
+#endif
+
+/**
+ * A generated topology of nodes (no routers).
+ * The links are kept as an edge list, which is also used as the
+ * blockchain connections, and the neighbours of each node are
+ * indexed in compressed sparse row form once generation is finished:
+ * the neighbours of node i are
+ * neighbours[neighbourOffsets[i]] ... neighbours[neighbourOffsets[i+1]-1]
+ */
+struct GeneratedTopology {
+  int numberOfNodes = 0;
+  std::vector<std::pair<int, int>> links;
+  std::vector<int> degree;
+  std::vector<int> neighbourOffsets;
+  std::vector<int> neighbours;
+  std::unordered_set<uint64_t> linkSet; // only used while generating
+};
+
+/**
+ * Start generating a topology
+ *
+ * \param topology The topology to reset
+ * \param numberOfNodes The number of nodes
+ * \param expectedLinks The expected number of links, used to pre-size
+ */
+void initGeneratedTopology (GeneratedTopology &topology, int numberOfNodes, size_t expectedLinks) {
+  topology.numberOfNodes = numberOfNodes;
+  topology.links.clear();
+  topology.links.reserve(expectedLinks);
+  topology.degree.assign(numberOfNodes, 0);
+  topology.neighbourOffsets.clear();
+  topology.neighbours.clear();
+  topology.linkSet.clear();
+  topology.linkSet.reserve(expectedLinks);
+}
+
+/**
+ * Check whether two nodes are already linked in a generated topology
+ *
+ * \param topology The topology being generated
+ * \param a A node number
+ * \param b A node number
+ *
+ * \return true if a and b are linked
+ */
+bool hasGeneratedLink (const GeneratedTopology &topology, int a, int b) {
+  uint64_t key = ((uint64_t) std::min(a, b) << 32) | (uint32_t) std::max(a, b);
+  return topology.linkSet.count(key) != 0;
+}
+
+/**
+ * Add a link to a generated topology, unless it is a
+ * link between a node and itself or a duplicate
+ *
+ * \param topology The topology being generated
+ * \param a A node number
+ * \param b A node number
+ *
+ * \return true if the link was added
+ */
+bool addGeneratedLink (GeneratedTopology &topology, int a, int b) {
+  if (a == b) {
+      return false;
+  }
+  uint64_t key = ((uint64_t) std::min(a, b) << 32) | (uint32_t) std::max(a, b);
+  if (!topology.linkSet.insert(key).second) {
+      return false;
+  }
+  topology.links.push_back(std::make_pair(a, b));
+  topology.degree[a]++;
+  topology.degree[b]++;
+  return true;
+}
+
+/**
+ * Pick a random node that satisfies a condition.
+ * Uses rejection sampling, falling back to a scan from a random
+ * start when the condition rejects most nodes.
+ *
+ * \param numberOfNodes The number of nodes
+ * \param rng The random number generator
+ * \param acceptable The condition the node must satisfy
+ *
+ * \return the node number, or -1 if no node satisfies the condition
+ */
+template <typename Condition>
+int pickRandomNode (int numberOfNodes, std::mt19937 &rng, Condition acceptable) {
+  std::uniform_int_distribution<int> uniform (0, numberOfNodes - 1);
+  for (int attempt = 0; attempt < 64; attempt++) {
+      int candidate = uniform(rng);
+      if (acceptable(candidate)) {
+          return candidate;
+      }
+  }
+  int start = uniform(rng);
+  for (int k = 0; k < numberOfNodes; k++) {
+      int candidate = (start + k) % numberOfNodes;
+      if (acceptable(candidate)) {
+          return candidate;
+      }
+  }
+  return -1;
+}
+
+/**
+ * Check whether every node of a generated topology can reach every other
+ *
+ * \param topology The topology being generated
+ *
+ * \return true if the topology is connected
+ */
+bool generatedTopologyConnected (const GeneratedTopology &topology) {
+  std::vector<int> parent (topology.numberOfNodes);
+  for (int v = 0; v < topology.numberOfNodes; v++) {
+      parent[v] = v;
+  }
+  auto find = [&parent] (int v) {
+      while (parent[v] != v) {
+          parent[v] = parent[parent[v]];
+          v = parent[v];
+      }
+      return v;
+  };
+  int components = topology.numberOfNodes;
+  for (const auto &link : topology.links) {
+      int a = find(link.first);
+      int b = find(link.second);
+      if (a != b) {
+          parent[a] = b;
+          components--;
+      }
+  }
+  return components <= 1;
+}
+
+/**
+ * Join the connected components of a generated topology
+ * by linking a random node of each component to a random
+ * node of the next one.
+ *
+ * \param topology The topology being generated
+ * \param rng The random number generator
+ */
+void connectGeneratedComponents (GeneratedTopology &topology, std::mt19937 &rng) {
+  int n = topology.numberOfNodes;
+  std::vector<int> parent (n);
+  for (int v = 0; v < n; v++) {
+      parent[v] = v;
+  }
+  auto find = [&parent] (int v) {
+      while (parent[v] != v) {
+          parent[v] = parent[parent[v]];
+          v = parent[v];
+      }
+      return v;
+  };
+  for (const auto &link : topology.links) {
+      parent[find(link.first)] = find(link.second);
+  }
+
+  std::unordered_map<int, std::vector<int>> components;
+  for (int v = 0; v < n; v++) {
+      components[find(v)].push_back(v);
+  }
+  if (components.size() <= 1) {
+      return;
+  }
+  std::vector<std::vector<int>> ordered;
+  for (auto &it : components) {
+      ordered.push_back(std::move(it.second));
+  }
+  // unordered_map iteration order is not portable
+  std::sort(ordered.begin(), ordered.end());
+  for (size_t c = 0; c + 1 < ordered.size(); c++) {
+      std::uniform_int_distribution<size_t> fromDist (0, ordered[c].size() - 1);
+      std::uniform_int_distribution<size_t> toDist (0, ordered[c + 1].size() - 1);
+      addGeneratedLink(topology, ordered[c][fromDist(rng)], ordered[c + 1][toDist(rng)]);
+  }
+}
+
+/**
+ * Build the neighbour index of a generated topology
+ * once all links have been added.
+ *
+ * \param topology The generated topology
+ */
+void finishGeneratedTopology (GeneratedTopology &topology) {
+  int n = topology.numberOfNodes;
+  topology.neighbourOffsets.assign(n + 1, 0);
+  for (int v = 0; v < n; v++) {
+      topology.neighbourOffsets[v + 1] = topology.neighbourOffsets[v] + topology.degree[v];
+  }
+  topology.neighbours.resize(topology.neighbourOffsets[n]);
+  std::vector<int> next (topology.neighbourOffsets.begin(), topology.neighbourOffsets.end() - 1);
+  for (const auto &link : topology.links) {
+      topology.neighbours[next[link.first]++] = link.second;
+      topology.neighbours[next[link.second]++] = link.first;
+  }
+  topology.linkSet = std::unordered_set<uint64_t> ();
+}
+
+/**
+ * Generate a ring of nodes, then give every node random extra
+ * links until it has at least the minimum number of connections.
+ * This is the original minConnectionsPerNode topology.
+ *
+ * \param topology The topology to generate
+ * \param numberOfNodes The number of nodes
+ * \param minConnections The minimum number of connections per node
+ * \param rng The random number generator
+ */
+void generateMinConnectionsTopology (GeneratedTopology &topology, int numberOfNodes, int minConnections, std::mt19937 &rng) {
+  initGeneratedTopology(topology, numberOfNodes, (size_t) numberOfNodes * minConnections);
+  // do this to make sure graph is connected
+  for (int i = 0; i < numberOfNodes; i++) {
+      addGeneratedLink(topology, i, (i + 1) % numberOfNodes);
+  }
+  if (minConnections <= 2) {
+      return;
+  }
+  for (int i = 0; i < numberOfNodes; i++) {
+      while (topology.degree[i] < minConnections) {
+          int peer = pickRandomNode(numberOfNodes, rng, [&] (int candidate) {
+              return candidate != i && !hasGeneratedLink(topology, i, candidate);
+          });
+          if (peer < 0) {
+              break;
+          }
+          addGeneratedLink(topology, i, peer);
+      }
+  }
+}
+
+/**
+ * Generate a random regular topology, where every node has
+ * exactly the same number of connections.
+ * Connection stubs are paired at random, rejecting self links and
+ * duplicates, and the pairing is restarted if it gets stuck or the
+ * result is disconnected (joining components would break regularity).
+ * Needs a degree of at least 3, with degree 2 the result is a union
+ * of cycles and almost never connected.
+ *
+ * \param topology The topology to generate
+ * \param numberOfNodes The number of nodes
+ * \param degree The number of connections of every node
+ * \param rng The random number generator
+ *
+ * \return false if no regular topology could be generated
+ */
+bool generateRandomRegularTopology (GeneratedTopology &topology, int numberOfNodes, int degree, std::mt19937 &rng) {
+  std::vector<int> stubs;
+  for (int restart = 0; restart < 100; restart++) {
+      initGeneratedTopology(topology, numberOfNodes, (size_t) numberOfNodes * degree / 2);
+      stubs.clear();
+      for (int v = 0; v < numberOfNodes; v++) {
+          stubs.insert(stubs.end(), degree, v);
+      }
+      bool stuck = false;
+      while (!stubs.empty() && !stuck) {
+          stuck = true;
+          for (int attempt = 0; attempt < 100; attempt++) {
+              std::uniform_int_distribution<size_t> uniform (0, stubs.size() - 1);
+              size_t x = uniform(rng);
+              size_t y = uniform(rng);
+              if (x == y || !addGeneratedLink(topology, stubs[x], stubs[y])) {
+                  continue;
+              }
+              // remove both stubs, highest index first
+              if (x < y) {
+                  std::swap(x, y);
+              }
+              stubs[x] = stubs.back();
+              stubs.pop_back();
+              stubs[y] = stubs.back();
+              stubs.pop_back();
+              stuck = false;
+              break;
+          }
+      }
+      if (!stuck && generatedTopologyConnected(topology)) {
+          return true;
+      }
+  }
+  return false;
+}
+
+/**
+ * Generate an Erdos-Renyi G(n, p) topology, with p chosen to give the
+ * requested average number of connections. Uses geometric skipping
+ * (Batagelj and Brandes) so the cost is proportional to the number of
+ * links rather than the number of node pairs.
+ * Disconnected components are then joined.
+ *
+ * \param topology The topology to generate
+ * \param numberOfNodes The number of nodes
+ * \param averageConnections The average number of connections per node
+ * \param rng The random number generator
+ */
+void generateErdosRenyiTopology (GeneratedTopology &topology, int numberOfNodes, double averageConnections, std::mt19937 &rng) {
+  double p = std::min(1.0, averageConnections / (numberOfNodes - 1));
+  initGeneratedTopology(topology, numberOfNodes, (size_t) (numberOfNodes * averageConnections / 2) + numberOfNodes);
+  std::uniform_real_distribution<double> uniform (0.0, 1.0);
+  if (p >= 1.0) {
+      for (int v = 0; v < numberOfNodes; v++) {
+          for (int w = 0; w < v; w++) {
+              addGeneratedLink(topology, v, w);
+          }
+      }
+  } else {
+      double logQ = std::log(1.0 - p);
+      long v = 1;
+      long w = -1;
+      while (v < numberOfNodes) {
+          w += 1 + (long) std::floor(std::log(1.0 - uniform(rng)) / logQ);
+          while (w >= v && v < numberOfNodes) {
+              w -= v;
+              v++;
+          }
+          if (v < numberOfNodes) {
+              addGeneratedLink(topology, v, w);
+          }
+      }
+  }
+  connectGeneratedComponents(topology, rng);
+}
+
+/**
+ * Generate a Barabasi-Albert preferential attachment topology.
+ * Starts from a complete graph of links + 1 nodes, then each new node
+ * links to that many distinct existing nodes chosen in proportion to
+ * their number of connections.
+ *
+ * \param topology The topology to generate
+ * \param numberOfNodes The number of nodes
+ * \param links The number of links each new node makes
+ * \param rng The random number generator
+ */
+void generateBarabasiAlbertTopology (GeneratedTopology &topology, int numberOfNodes, int links, std::mt19937 &rng) {
+  initGeneratedTopology(topology, numberOfNodes, (size_t) numberOfNodes * links);
+  // every link appears twice, once for each end, so picking uniformly
+  // from this picks a node in proportion to its number of connections
+  std::vector<int> linkEnds;
+  linkEnds.reserve((size_t) numberOfNodes * links * 2);
+  int initial = std::min(numberOfNodes, links + 1);
+  for (int v = 0; v < initial; v++) {
+      for (int w = 0; w < v; w++) {
+          addGeneratedLink(topology, v, w);
+          linkEnds.push_back(v);
+          linkEnds.push_back(w);
+      }
+  }
+  std::vector<int> targets;
+  for (int v = initial; v < numberOfNodes; v++) {
+      targets.clear();
+      std::uniform_int_distribution<size_t> uniform (0, linkEnds.size() - 1);
+      while ((int) targets.size() < links) {
+          int target = linkEnds[uniform(rng)];
+          if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+              targets.push_back(target);
+          }
+      }
+      for (int target : targets) {
+          addGeneratedLink(topology, v, target);
+          linkEnds.push_back(v);
+          linkEnds.push_back(target);
+      }
+  }
+}
+
+/**
+ * Generate a Bitcoin-like topology. In a random order every node
+ * opens outbound connections to random peers that still accept
+ * inbound connections (like Bitcoin Core's 8 outbound and 125
+ * inbound limits). Disconnected components are then joined.
+ *
+ * \param topology The topology to generate
+ * \param numberOfNodes The number of nodes
+ * \param outbound The number of outbound connections of each node
+ * \param maxInbound The maximum number of inbound connections of a node
+ * \param rng The random number generator
+ */
+void generateBitcoinTopology (GeneratedTopology &topology, int numberOfNodes, int outbound, int maxInbound, std::mt19937 &rng) {
+  initGeneratedTopology(topology, numberOfNodes, (size_t) numberOfNodes * outbound);
+  std::vector<int> inbound (numberOfNodes, 0);
+  std::vector<int> order (numberOfNodes);
+  for (int v = 0; v < numberOfNodes; v++) {
+      order[v] = v;
+  }
+  std::shuffle(order.begin(), order.end(), rng);
+  for (int v : order) {
+      for (int k = 0; k < outbound; k++) {
+          int peer = pickRandomNode(numberOfNodes, rng, [&] (int candidate) {
+              return candidate != v && inbound[candidate] < maxInbound && !hasGeneratedLink(topology, v, candidate);
+          });
+          if (peer < 0) {
+              break;
+          }
+          addGeneratedLink(topology, v, peer);
+          inbound[peer]++;
+      }
+  }
+  connectGeneratedComponents(topology, rng);
+}
+
+/**
+ * A topology read from a topology file
+ */
+struct TopologyFile {
+  int numberOfNodes = -1;
+  int numberOfRouters = 0;
+  std::vector<std::pair<int, int>> links; // routers are numbered after the nodes
+  std::vector<std::string> linkDelays; // "" if the link uses the default delay
+  std::vector<std::string> linkDataRates; // "" if the link uses the default data rate
+  std::vector<std::pair<int, int>> connections; // empty if the links are the connections
+};
+
+/**
+ * Parse a node or router in a topology file e.g. 'n4' or 'r0'
+ *
+ * \param token The node or router
+ * \param topology The topology read so far
+ * \param allowRouters False if only nodes are allowed
+ * \param value Set to the node number (routers are numbered after the nodes)
+ * \param error Set to the error message if the node is not valid
+ *
+ * \return true if the node is valid
+ */
+bool parseTopologyFileNode (const std::string &token, const TopologyFile &topology, bool allowRouters, int &value, std::string &error) {
+  if (token.size() < 2 || (token[0] != 'n' && token[0] != 'r')) {
+      error = "expected a node (n<number>) or router (r<number>) but found '" + token + "'";
+      return false;
+  }
+  if (token[0] == 'r' && !allowRouters) {
+      error = "connections can only be between nodes but found '" + token + "'";
+      return false;
+  }
+  char *end = nullptr;
+  long number = std::strtol(token.c_str() + 1, &end, 10);
+  if (*end != '\0' || number < 0) {
+      error = "invalid number in '" + token + "'";
+      return false;
+  }
+  if (token[0] == 'n') {
+      if (number >= topology.numberOfNodes) {
+          error = "node '" + token + "' does not exist, there are " + std::to_string(topology.numberOfNodes) + " nodes";
+          return false;
+      }
+      value = number;
+  } else {
+      if (number >= topology.numberOfRouters) {
+          error = "router '" + token + "' does not exist, there are " + std::to_string(topology.numberOfRouters) + " routers";
+          return false;
+      }
+      value = topology.numberOfNodes + number;
+  }
+  return true;
+}
+
+/**
+ * Check a delay or data rate from a topology file is a number followed by
+ * one of the units ns-3 accepts for it, so a bad value is reported with
+ * its line number instead of aborting when the attribute is set
+ *
+ * \param value The delay or data rate e.g. '20ms' or '5Mbps'
+ * \param units The accepted units ("" if the number alone is accepted)
+ *
+ * \return true if the value is valid
+ */
+bool validTopologyFileQuantity (const std::string &value, const std::vector<std::string> &units) {
+  if (value.empty() || !(std::isdigit((unsigned char) value[0]) || value[0] == '.')) {
+      return false;
+  }
+  char *end = nullptr;
+  double number = std::strtod(value.c_str(), &end);
+  if (end == value.c_str() || !std::isfinite(number) || number < 0) {
+      return false;
+  }
+  return std::find(units.begin(), units.end(), std::string (end)) != units.end();
+}
+
+/**
+ * Load a topology from a file instead of the command line.
+ * One entry per line, fields separated by spaces or commas,
+ * '#' starts a comment:
+ *
+ *   nodes 3
+ *   routers 1
+ *   link n0 r0 2ms 5Mbps
+ *   link r0 n1           # default delay and data rate
+ *   link n1 n2 20ms
+ *   connection n0 n1
+ *   connection n1 n2
+ *
+ * nodes and routers must be given before the links that use them.
+ * If there are no connection lines the links are also used
+ * as the blockchain connections (like --links on its own).
+ * The whole file is read at once and parsed in place.
+ *
+ * \param fileName The topology file
+ * \param topology Filled with the topology
+ *
+ * \return false if the file cannot be read or is invalid
+ */
+bool loadTopologyFile (const std::string &fileName, TopologyFile &topology) {
+  BCS_PROFILE_SCOPE ("setup: load topology file");
+  std::error_code fileError;
+  if (!std::filesystem::exists(fileName, fileError)) {
+      std::cerr << "Could not open topology file " << fileName << ", it does not exist" << std::endl;
+      return false;
+  }
+  if (!std::filesystem::is_regular_file(fileName, fileError)) {
+      std::cerr << "Could not open topology file " << fileName << ", it is not a file" << std::endl;
+      return false;
+  }
+  std::ifstream file (fileName, std::ios::binary);
+  if (!file) {
+      std::cerr << "Could not open topology file " << fileName << std::endl;
+      return false;
+  }
+  file.seekg(0, std::ios::end);
+  std::streamoff size = file.tellg();
+  if (size < 0) {
+      std::cerr << "Could not read topology file " << fileName << std::endl;
+      return false;
+  }
+  std::string contents (size, '\0');
+  file.seekg(0, std::ios::beg);
+  if (!file.read(&contents[0], contents.size())) {
+      std::cerr << "Could not read topology file " << fileName << std::endl;
+      return false;
+  }
+  file.close();
+
+  // the most nodes or routers a file may give
+  const long maxCount = 10000000;
+  const std::vector<std::string> delayUnits = {"", "s", "ms", "us", "ns", "ps", "fs", "min", "h", "d", "y"};
+  const std::vector<std::string> dataRateUnits = {"", "bps", "b/s", "Bps", "B/s",
+      "kbps", "kb/s", "Kbps", "Kb/s", "kBps", "kB/s", "KBps", "KB/s", "Kib/s", "KiB/s",
+      "Mbps", "Mb/s", "MBps", "MB/s", "Mib/s", "MiB/s",
+      "Gbps", "Gb/s", "GBps", "GB/s", "Gib/s", "GiB/s"};
+  bool nodesGiven = false;
+  bool routersGiven = false;
+
+  std::vector<std::string> fields;
+  std::string error;
+  size_t position = 0;
+  int lineNumber = 0;
+  while (position < contents.size()) {
+      size_t lineEnd = contents.find('\n', position);
+      if (lineEnd == std::string::npos) {
+          lineEnd = contents.size();
+      }
+      lineNumber++;
+
+      // split the line into fields, ignoring comments
+      fields.clear();
+      size_t i = position;
+      while (i < lineEnd && contents[i] != '#') {
+          char c = contents[i];
+          if (c == ' ' || c == '\t' || c == ',' || c == '\r') {
+              i++;
+              continue;
+          }
+          size_t start = i;
+          while (i < lineEnd) {
+              c = contents[i];
+              if (c == ' ' || c == '\t' || c == ',' || c == '\r' || c == '#') {
+                  break;
+              }
+              i++;
+          }
+          fields.emplace_back(contents, start, i - start);
+      }
+      position = lineEnd + 1;
+      if (fields.empty()) {
+          continue;
+      }
+
+      const std::string &keyword = fields[0];
+      if (keyword == "nodes" || keyword == "routers") {
+          char *end = nullptr;
+          long count = fields.size() == 2 ? std::strtol(fields[1].c_str(), &end, 10) : -1;
+          bool &given = keyword == "nodes" ? nodesGiven : routersGiven;
+          if (fields.size() != 2 || *end != '\0' || count < 0) {
+              error = "expected '" + keyword + " <number>'";
+          } else if (given) {
+              error = "'" + keyword + "' is given more than once";
+          } else if (!topology.links.empty() || !topology.connections.empty()) {
+              error = "'" + keyword + "' must come before the links and connections";
+          } else if (count > maxCount) {
+              error = "cannot have more than " + std::to_string(maxCount) + " " + keyword;
+          } else if (keyword == "nodes") {
+              if (count < 2) {
+                  error = "number of nodes cannot be less than two";
+              }
+              topology.numberOfNodes = count;
+          } else {
+              topology.numberOfRouters = count;
+          }
+          given = true;
+      } else if (keyword == "link") {
+          int a = 0;
+          int b = 0;
+          if (topology.numberOfNodes < 0) {
+              error = "'nodes' must be given before the links";
+          } else if (fields.size() < 3 || fields.size() > 5) {
+              error = "expected 'link <from> <to> [delay] [data rate]'";
+          } else if (parseTopologyFileNode(fields[1], topology, true, a, error)
+                     && parseTopologyFileNode(fields[2], topology, true, b, error)) {
+              if (a == b) {
+                  error = "cannot create a link between '" + fields[1] + "' and itself";
+              } else if (fields.size() > 3 && !validTopologyFileQuantity(fields[3], delayUnits)) {
+                  error = "invalid delay '" + fields[3] + "', expected a number and a unit e.g. '20ms'";
+              } else if (fields.size() > 4 && !validTopologyFileQuantity(fields[4], dataRateUnits)) {
+                  error = "invalid data rate '" + fields[4] + "', expected a number and a unit e.g. '5Mbps'";
+              } else {
+                  topology.links.push_back(std::make_pair(a, b));
+                  topology.linkDelays.push_back(fields.size() > 3 ? fields[3] : "");
+                  topology.linkDataRates.push_back(fields.size() > 4 ? fields[4] : "");
+              }
+          }
+      } else if (keyword == "connection") {
+          int a = 0;
+          int b = 0;
+          if (topology.numberOfNodes < 0) {
+              error = "'nodes' must be given before the connections";
+          } else if (fields.size() != 3) {
+              error = "expected 'connection <node> <node>'";
+          } else if (parseTopologyFileNode(fields[1], topology, false, a, error)
+                     && parseTopologyFileNode(fields[2], topology, false, b, error)) {
+              if (a == b) {
+                  error = "cannot create a connection between '" + fields[1] + "' and itself";
+              } else {
+                  topology.connections.push_back(std::make_pair(a, b));
+              }
+          }
+      } else {
+          error = "unknown entry '" + keyword + "', expected nodes, routers, link or connection";
+      }
+
+      if (!error.empty()) {
+          std::cerr << fileName << ":" << lineNumber << ": " << error << std::endl;
+          return false;
+      }
+  }
+
+  if (topology.numberOfNodes < 0) {
+      std::cerr << fileName << ": the number of nodes is not given" << std::endl;
+      return false;
+  }
+  if (topology.links.empty()) {
+      std::cerr << fileName << ": there are no links" << std::endl;
+      return false;
+  }
+  return true;
+}
+
+/**
+ * A host route: on node, packets to destination leave through interface
+ */
+struct HostRoute {
+  int node;
+  uint32_t destination;
+  uint32_t interface;
+};
+
+/**
+ * Compute the host routes needed by the blockchain connections only,
+ * instead of routes between every pair of nodes.
+ *
+ * For every node with connections, a breadth first search finds the
+ * fewest hop path (the same metric global routing uses) to each peer,
+ * stopping once all of its peers are found. Along each path a route to
+ * the peer's address is added in the forward direction, and a route
+ * back to the address the node sends from (its address on the first
+ * link of the path) in the reverse direction. Each route follows a
+ * shortest path to the node owning the address, so routes added for
+ * different sources through the same router never form loops.
+ * A node's own first hop routes take precedence over routes added for
+ * paths passing through it, so that it sends from the address the
+ * reverse routes lead back to.
+ *
+ * Sources are searched in parallel. The routes are only computed here,
+ * they must be installed by the caller as ns-3 objects are not thread safe.
+ *
+ * \param numberOfVertices The number of nodes plus routers
+ * \param linkEndpoints The node (or router) numbers at each end of each link
+ * \param linkAddresses The address of each end of each link (2 per link)
+ * \param linkInterfaces The Ipv4 interface of each end of each link (2 per link)
+ * \param peerAddresses The addresses each node connects to
+ * \param ipNodeNumberMap The map with key: IpAddress, value: Node Number
+ *
+ * \return the routes, without duplicates
+ */
+std::vector<HostRoute> computePeerRoutes (
+    int numberOfVertices,
+    const std::vector<std::pair<int, int>> &linkEndpoints,
+    const std::vector<uint32_t> &linkAddresses,
+    const std::vector<uint32_t> &linkInterfaces,
+    const std::vector<std::vector<uint32_t>> &peerAddresses,
+    const std::unordered_map<uint32_t, int> &ipNodeNumberMap) {
+  BCS_PROFILE_SCOPE ("setup: compute peer routes");
+  // Links of each node in compressed sparse row form, as link * 2 + side
+  std::vector<int> offsets (numberOfVertices + 1, 0);
+  for (const auto &link : linkEndpoints) {
+      offsets[link.first + 1]++;
+      offsets[link.second + 1]++;
+  }
+  for (int v = 0; v < numberOfVertices; v++) {
+      offsets[v + 1] += offsets[v];
+  }
+  std::vector<int> linkEnds (offsets[numberOfVertices]);
+  std::vector<int> next (offsets.begin(), offsets.end() - 1);
+  for (size_t l = 0; l < linkEndpoints.size(); l++) {
+      linkEnds[next[linkEndpoints[l].first]++] = l * 2;
+      linkEnds[next[linkEndpoints[l].second]++] = l * 2 + 1;
+  }
+
+  std::vector<int> sources;
+  for (size_t u = 0; u < peerAddresses.size(); u++) {
+      if (!peerAddresses[u].empty()) {
+          sources.push_back(u);
+      }
+  }
+
+  unsigned numberOfThreads = std::max(1u, std::thread::hardware_concurrency());
+  numberOfThreads = std::min<unsigned> (numberOfThreads, std::max<size_t> (1, sources.size()));
+  std::vector<std::vector<HostRoute>> threadRoutes (numberOfThreads);
+  std::vector<std::vector<HostRoute>> threadFirstHopRoutes (numberOfThreads);
+  std::atomic<size_t> nextSource (0);
+
+  auto worker = [&] (unsigned thread) {
+      std::vector<HostRoute> &routes = threadRoutes[thread];
+      std::vector<HostRoute> &firstHopRoutes = threadFirstHopRoutes[thread];
+      std::vector<int> parentLinkEnd (numberOfVertices, -1); // link end the vertex was reached through
+      std::vector<char> visited (numberOfVertices, 0);
+      std::vector<char> wanted (numberOfVertices, 0);
+      std::vector<int> queue;
+      std::vector<int> path;
+      for (size_t s = nextSource++; s < sources.size(); s = nextSource++) {
+          int u = sources[s];
+          int remaining = 0;
+          for (uint32_t address : peerAddresses[u]) {
+              auto owner = ipNodeNumberMap.find(address);
+              if (owner != ipNodeNumberMap.end() && owner->second != u && !wanted[owner->second]) {
+                  wanted[owner->second] = 1;
+                  remaining++;
+              }
+          }
+
+          queue.clear();
+          queue.push_back(u);
+          visited[u] = 1;
+          for (size_t head = 0; head < queue.size() && remaining > 0; head++) {
+              int v = queue[head];
+              for (int k = offsets[v]; k < offsets[v + 1]; k++) {
+                  int end = linkEnds[k];
+                  const auto &link = linkEndpoints[end / 2];
+                  int w = (end % 2 == 0) ? link.second : link.first;
+                  if (visited[w]) {
+                      continue;
+                  }
+                  visited[w] = 1;
+                  parentLinkEnd[w] = end;
+                  queue.push_back(w);
+                  if (wanted[w]) {
+                      remaining--;
+                  }
+              }
+          }
+
+          for (uint32_t address : peerAddresses[u]) {
+              auto owner = ipNodeNumberMap.find(address);
+              if (owner == ipNodeNumberMap.end() || owner->second == u || !visited[owner->second]) {
+                  continue;
+              }
+              // walk back from the peer, collecting the link ends used on the way out
+              path.clear();
+              for (int v = owner->second; v != u; ) {
+                  int end = parentLinkEnd[v];
+                  path.push_back(end);
+                  const auto &link = linkEndpoints[end / 2];
+                  v = (end % 2 == 0) ? link.first : link.second;
+              }
+              uint32_t sourceAddress = linkAddresses[path.back()];
+              for (int end : path) {
+                  int from = (end % 2 == 0) ? linkEndpoints[end / 2].first : linkEndpoints[end / 2].second;
+                  int to = (end % 2 == 0) ? linkEndpoints[end / 2].second : linkEndpoints[end / 2].first;
+                  int otherEnd = end ^ 1;
+                  if (from == u) {
+                      firstHopRoutes.push_back(HostRoute {from, address, linkInterfaces[end]});
+                  } else {
+                      routes.push_back(HostRoute {from, address, linkInterfaces[end]});
+                  }
+                  routes.push_back(HostRoute {to, sourceAddress, linkInterfaces[otherEnd]});
+              }
+          }
+
+          for (int v : queue) {
+              visited[v] = 0;
+          }
+          for (uint32_t address : peerAddresses[u]) {
+              auto owner = ipNodeNumberMap.find(address);
+              if (owner != ipNodeNumberMap.end()) {
+                  wanted[owner->second] = 0;
+              }
+          }
+      }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numberOfThreads; t++) {
+      threads.emplace_back(worker, t);
+  }
+  worker(0);
+  for (std::thread &thread : threads) {
+      thread.join();
+  }
+
+  std::vector<HostRoute> routes;
+  std::unordered_set<uint64_t> installed;
+  auto merge = [&routes, &installed] (const std::vector<std::vector<HostRoute>> &computed) {
+      for (const std::vector<HostRoute> &thread : computed) {
+          for (const HostRoute &route : thread) {
+              uint64_t key = ((uint64_t) route.node << 32) | route.destination;
+              if (installed.insert(key).second) {
+                  routes.push_back(route);
+              }
+          }
+      }
+  };
+  merge(threadFirstHopRoutes);
+  merge(threadRoutes);
+  return routes;
+}
+
+/**
+ * Partition the nodes and routers between the ranks of a distributed simulation.
+ * The lookahead of the distributed simulator is the smallest delay of a link
+ * crossing two partitions, so each link is weighted by 1/delay and the weighted
+ * cut is minimised, keeping every partition within 5% (at least one node) of
+ * numberOfVertices / numberOfPartitions.
+ *
+ * Links are first contracted from the shortest delay upwards into clusters no
+ * larger than one partition and the clusters are placed on the partition they
+ * are most strongly connected to. Nodes are then moved from the largest to the
+ * smallest partition until all partitions are within the bounds, and finally
+ * single nodes are moved between partitions while that lowers the weighted cut
+ * and keeps both partitions within the bounds.
+ * If there are at least as many vertices as partitions no partition is empty.
+ *
+ * \param numberOfVertices The number of nodes plus routers
+ * \param linkEndpoints The node (or router) numbers at each end of each link
+ * \param linkDelays The delay of each link in seconds
+ * \param numberOfPartitions The number of partitions (ranks)
+ *
+ * \return the partition of each node (or router)
+ */
+std::vector<uint32_t> partitionTopology (
+    int numberOfVertices,
+    const std::vector<std::pair<int, int>> &linkEndpoints,
+    const std::vector<double> &linkDelays,
+    uint32_t numberOfPartitions) {
+  BCS_PROFILE_SCOPE ("setup: partition topology");
+  std::vector<uint32_t> partition (numberOfVertices, 0);
+  if (numberOfPartitions <= 1 || numberOfVertices == 0) {
+      return partition;
+  }
+
+  int capacity = (numberOfVertices + numberOfPartitions - 1) / numberOfPartitions;
+  int slack = std::max(1, capacity / 20);
+  int minSize = std::max(1, (int) (numberOfVertices / numberOfPartitions) - slack);
+  int maxSize = capacity + slack;
+
+  std::vector<double> linkWeights (linkEndpoints.size());
+  std::vector<std::vector<std::pair<int, double>>> adjacency (numberOfVertices);
+  for (size_t l = 0; l < linkEndpoints.size(); l++) {
+      linkWeights[l] = linkDelays[l] > 0 ? 1.0 / linkDelays[l] : 1e12;
+      adjacency[linkEndpoints[l].first].push_back(std::make_pair(linkEndpoints[l].second, linkWeights[l]));
+      adjacency[linkEndpoints[l].second].push_back(std::make_pair(linkEndpoints[l].first, linkWeights[l]));
+  }
+
+  // Contract the shortest delay links first (union find)
+  std::vector<int> parent (numberOfVertices);
+  std::vector<int> clusterSize (numberOfVertices, 1);
+  for (int v = 0; v < numberOfVertices; v++) {
+      parent[v] = v;
+  }
+  auto find = [&parent] (int v) {
+      while (parent[v] != v) {
+          parent[v] = parent[parent[v]];
+          v = parent[v];
+      }
+      return v;
+  };
+  std::vector<size_t> order (linkEndpoints.size());
+  for (size_t l = 0; l < order.size(); l++) {
+      order[l] = l;
+  }
+  std::stable_sort(order.begin(), order.end(), [&linkWeights] (size_t a, size_t b) {
+      return linkWeights[a] > linkWeights[b];
+  });
+  for (size_t l : order) {
+      int a = find(linkEndpoints[l].first);
+      int b = find(linkEndpoints[l].second);
+      if (a != b && clusterSize[a] + clusterSize[b] <= capacity) {
+          parent[b] = a;
+          clusterSize[a] += clusterSize[b];
+      }
+  }
+
+  std::unordered_map<int, std::vector<int>> clusterMembers;
+  for (int v = 0; v < numberOfVertices; v++) {
+      clusterMembers[find(v)].push_back(v);
+  }
+  std::vector<std::vector<int>> clusters;
+  clusters.reserve(clusterMembers.size());
+  for (auto &it : clusterMembers) {
+      clusters.push_back(std::move(it.second));
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [] (const std::vector<int> &a, const std::vector<int> &b) {
+      if (a.size() != b.size()) {
+          return a.size() > b.size();
+      }
+      return a.front() < b.front();
+  });
+
+  // Place the largest clusters first, next to what they are connected to
+  const uint32_t unassigned = numberOfPartitions;
+  std::fill(partition.begin(), partition.end(), unassigned);
+  std::vector<int> partitionSize (numberOfPartitions, 0);
+  std::vector<double> connection (numberOfPartitions);
+  for (const std::vector<int> &cluster : clusters) {
+      std::fill(connection.begin(), connection.end(), 0.0);
+      for (int v : cluster) {
+          for (const auto &neighbour : adjacency[v]) {
+              if (partition[neighbour.first] != unassigned) {
+                  connection[partition[neighbour.first]] += neighbour.second;
+              }
+          }
+      }
+      uint32_t best = 0;
+      bool found = false;
+      for (uint32_t p = 0; p < numberOfPartitions; p++) {
+          if (partitionSize[p] + (int) cluster.size() > capacity) {
+              continue;
+          }
+          if (!found || connection[p] > connection[best]
+              || (connection[p] == connection[best] && partitionSize[p] < partitionSize[best])) {
+              best = p;
+              found = true;
+          }
+      }
+      if (!found) {
+          best = std::min_element(partitionSize.begin(), partitionSize.end()) - partitionSize.begin();
+      }
+      for (int v : cluster) {
+          partition[v] = best;
+      }
+      partitionSize[best] += cluster.size();
+  }
+
+  // Move the nodes that cut the fewest links from the largest to the smallest
+  // partition until every partition is within the bounds. Half the difference
+  // is moved each time, so the sizes always get closer together
+  std::vector<std::pair<double, int>> candidates;
+  while (true) {
+      uint32_t donor = std::max_element(partitionSize.begin(), partitionSize.end()) - partitionSize.begin();
+      uint32_t receiver = std::min_element(partitionSize.begin(), partitionSize.end()) - partitionSize.begin();
+      if (partitionSize[donor] <= maxSize && partitionSize[receiver] >= minSize) {
+          break;
+      }
+      candidates.clear();
+      for (int v = 0; v < numberOfVertices; v++) {
+          if (partition[v] != donor) {
+              continue;
+          }
+          double gain = 0;
+          for (const auto &neighbour : adjacency[v]) {
+              if (partition[neighbour.first] == receiver) {
+                  gain += neighbour.second;
+              } else if (partition[neighbour.first] == donor) {
+                  gain -= neighbour.second;
+              }
+          }
+          candidates.push_back(std::make_pair(-gain, v));
+      }
+      int count = std::max(1, (partitionSize[donor] - partitionSize[receiver]) / 2);
+      std::nth_element(candidates.begin(), candidates.begin() + (count - 1), candidates.end());
+      for (int c = 0; c < count; c++) {
+          partition[candidates[c].second] = receiver;
+      }
+      partitionSize[donor] -= count;
+      partitionSize[receiver] += count;
+  }
+
+  // Move single nodes while it lowers the weighted cut
+  for (int pass = 0; pass < 10; pass++) {
+      bool moved = false;
+      for (int v = 0; v < numberOfVertices; v++) {
+          std::fill(connection.begin(), connection.end(), 0.0);
+          for (const auto &neighbour : adjacency[v]) {
+              connection[partition[neighbour.first]] += neighbour.second;
+          }
+          uint32_t current = partition[v];
+          uint32_t best = current;
+          for (uint32_t p = 0; p < numberOfPartitions; p++) {
+              if (p != current && partitionSize[p] < maxSize && connection[p] > connection[best]) {
+                  best = p;
+              }
+          }
+          if (best != current && partitionSize[current] > minSize) {
+              partition[v] = best;
+              partitionSize[current]--;
+              partitionSize[best]++;
+              moved = true;
+          }
+      }
+      if (!moved) {
+          break;
+      }
+  }
+
+  return partition;
+}
+
+/**
+ * A block from BCSBCOutput/Mining events.csv
+ */
+struct MinedBlock {
+  std::string id;
+  std::string previousId;
+  int creator = -1;
+  int height = 0; // location in chain
+  double timeMined = 0;
+  int parent = -1; // index of the previous block, -1 if it was not mined in the run (genesis)
+  bool mainChain = false;
+};
+
+/**
+ * Read the blocks mined during the run and link each block to its parent
+ *
+ * \param blocks Filled with the mined blocks, in the order they were mined
+ *
+ * \return false if the file could not be read
+ */
+bool readMinedBlocks (std::vector<MinedBlock> &blocks) {
+  BCS_PROFILE_SCOPE ("output: read mining events");
+  std::ifstream mining ("BCSBCOutput/Mining events.csv");
+  if (!mining.is_open()) {
+      return false;
+  }
+  // Block Id, Previous Block Id,Creator Id,Location In Chain,Size,Reward,Time mined,...
+  std::string line;
+  std::getline(mining, line); // header
+  std::unordered_map<std::string, int> blockIndex;
+  while (std::getline(mining, line)) {
+      std::stringstream lineStream (line);
+      std::vector<std::string> fields;
+      std::string field;
+      while (fields.size() < 7 && std::getline(lineStream, field, ',')) {
+          fields.push_back(field);
+      }
+      if (fields.size() < 7) {
+          continue;
+      }
+      MinedBlock block;
+      try {
+          block.id = stringSplit(fields[0], ' ').at(0);
+          block.previousId = stringSplit(fields[1], ' ').at(0);
+          block.creator = std::stoi(fields[2]);
+          block.height = std::stoi(fields[3]);
+          block.timeMined = std::stod(fields[6]);
+      } catch (const std::exception& e) {
+          continue;
+      }
+      blockIndex[block.id] = blocks.size();
+      blocks.push_back(block);
+  }
+  for (MinedBlock &block : blocks) {
+      auto it = blockIndex.find(block.previousId);
+      if (it != blockIndex.end()) {
+          block.parent = it->second;
+      }
+  }
+  return true;
+}
+
+/**
+ * Mark the main chain: the highest block, the first mined
+ * if there are several, and its ancestors
+ *
+ * \param blocks The mined blocks
+ *
+ * \return the length of the main chain
+ */
+int markMainChain (std::vector<MinedBlock> &blocks) {
+  int numberOfBlocks = (int) blocks.size();
+  int tip = -1;
+  for (int b = 0; b < numberOfBlocks; b++) {
+      if (tip < 0 || blocks[b].height > blocks[tip].height
+          || (blocks[b].height == blocks[tip].height && blocks[b].timeMined < blocks[tip].timeMined)) {
+          tip = b;
+      }
+  }
+  int length = 0;
+  for (int b = tip; b >= 0 && !blocks[b].mainChain; b = blocks[b].parent) {
+      blocks[b].mainChain = true;
+      length++;
+  }
+  return length;
+}
+
+/**
+ * Write the chain quality metrics of the run:
+ * BCSBCOutput/Chain metrics.csv  main chain length, stale blocks and fork depths
+ * BCSBCOutput/Miner shares.csv   main chain blocks of each miner against its hash power
+ * A fork is a branch of stale blocks leaving the main chain,
+ * its depth is the number of blocks on its longest branch.
+ *
+ * \param blocks The mined blocks, with the main chain marked
+ * \param mainChainLength The length of the main chain
+ * \param hashPowers The hash power of each node
+ * \param totalHashPower The total hash power of all nodes
+ */
+void writeChainMetrics (const std::vector<MinedBlock> &blocks, int mainChainLength,
+    const std::vector<int> &hashPowers, int totalHashPower) {
+  BCS_PROFILE_SCOPE ("output: chain metrics");
+  int numberOfBlocks = (int) blocks.size();
+  int numberOfMiners = (int) hashPowers.size();
+  int staleBlocks = numberOfBlocks - mainChainLength;
+
+  // Every stale block belongs to the fork starting at its
+  // first stale ancestor. Parents are mined before their
+  // children, so one pass in mining order finds them all.
+  std::vector<int> forkStart (blocks.size(), -1);
+  std::vector<int> forkDepth (blocks.size(), 0);
+  for (int b = 0; b < numberOfBlocks; b++) {
+      if (blocks[b].mainChain) {
+          continue;
+      }
+      int parent = blocks[b].parent;
+      if (parent >= 0 && parent < b && !blocks[parent].mainChain) {
+          forkStart[b] = forkStart[parent];
+      } else {
+          forkStart[b] = b;
+      }
+      int start = forkStart[b];
+      forkDepth[start] = std::max(forkDepth[start], blocks[b].height - blocks[start].height + 1);
+  }
+  std::map<int, int> forkDepths; // depth to number of forks
+  int forks = 0;
+  for (int b = 0; b < numberOfBlocks; b++) {
+      if (forkStart[b] == b) {
+          forkDepths[forkDepth[b]]++;
+          forks++;
+      }
+  }
+
+  std::ofstream metrics ("BCSBCOutput/Chain metrics.csv");
+  metrics << "Metric,Value\n";
+  metrics << "Blocks mined," << blocks.size() << "\n";
+  metrics << "Main chain length," << mainChainLength << "\n";
+  metrics << "Stale blocks," << staleBlocks << "\n";
+  metrics << "Stale rate," << (blocks.empty() ? 0.0 : (double) staleBlocks / blocks.size()) << "\n";
+  metrics << "Forks," << forks << "\n";
+  for (const auto &depth : forkDepths) {
+      metrics << "Forks of depth " << depth.first << "," << depth.second << "\n";
+  }
+  metrics.close();
+
+  std::vector<int> mainChainBlocks (hashPowers.size(), 0);
+  std::vector<int> minerStaleBlocks (hashPowers.size(), 0);
+  for (const MinedBlock &block : blocks) {
+      if (block.creator < 0 || block.creator >= numberOfMiners) {
+          continue;
+      }
+      if (block.mainChain) {
+          mainChainBlocks[block.creator]++;
+      } else {
+          minerStaleBlocks[block.creator]++;
+      }
+  }
+  std::ofstream shares ("BCSBCOutput/Miner shares.csv");
+  shares << "Node,Hash power share,Main chain blocks,Main chain share,Stale blocks\n";
+  for (int n = 0; n < numberOfMiners; n++) {
+      if (hashPowers[n] == 0 && mainChainBlocks[n] == 0 && minerStaleBlocks[n] == 0) {
+          continue;
+      }
+      shares << n << ","
+             << (totalHashPower > 0 ? (double) hashPowers[n] / totalHashPower : 0.0) << ","
+             << mainChainBlocks[n] << ","
+             << (mainChainLength > 0 ? (double) mainChainBlocks[n] / mainChainLength : 0.0) << ","
+             << minerStaleBlocks[n] << "\n";
+  }
+  shares.close();
+
+  std::cout << "Main chain " << mainChainLength << " blocks, " << staleBlocks << " stale blocks in "
+            << forks << " forks" << std::endl;
+}
+
+/**
+ * Write the block tree of the run in a compact format
+ * edges: BCSBCOutput/Block tree.csv, one row per block with its height
+ * dot:   BCSBCOutput/Block tree.dot, GraphViz with linear runs of blocks
+ *        collapsed into one node
+ * With forksOnly, only the stale blocks and the main chain blocks they
+ * leave from are written, and the main chain is summarised in one node (dot).
+ *
+ * \param blocks The mined blocks, with the main chain marked
+ * \param mainChainLength The length of the main chain
+ * \param format 'edges' or 'dot'
+ * \param forksOnly True if only forks should be written
+ */
+void writeBlockTree (const std::vector<MinedBlock> &blocks, int mainChainLength,
+    const std::string &format, bool forksOnly) {
+  BCS_PROFILE_SCOPE ("output: block tree");
+  int numberOfBlocks = (int) blocks.size();
+  std::vector<int> children (blocks.size(), 0);
+  std::vector<bool> forkPoint (blocks.size(), false);
+  for (const MinedBlock &block : blocks) {
+      if (block.parent >= 0) {
+          children[block.parent]++;
+          if (!block.mainChain && blocks[block.parent].mainChain) {
+              forkPoint[block.parent] = true;
+          }
+      }
+  }
+
+  // Written in large chunks rather than a line at a time
+  std::string buffer;
+  buffer.reserve(1 << 20);
+  std::ofstream out;
+  auto flush = [&buffer, &out] (bool force) {
+      if (force || buffer.size() >= (1 << 20) - 256) {
+          out.write(buffer.data(), buffer.size());
+          buffer.clear();
+      }
+  };
+
+  if (format == "edges") {
+      out.open("BCSBCOutput/Block tree.csv");
+      buffer += "Block Id,Previous Block Id,Height,Creator Id,Main chain\n";
+      for (int b = 0; b < numberOfBlocks; b++) {
+          const MinedBlock &block = blocks[b];
+          if (forksOnly && block.mainChain && !forkPoint[b]) {
+              continue;
+          }
+          buffer += block.id + "," + block.previousId + "," + std::to_string(block.height) + ","
+                    + std::to_string(block.creator) + "," + (block.mainChain ? "1" : "0") + "\n";
+          flush(false);
+      }
+  } else {
+      out.open("BCSBCOutput/Block tree.dot");
+      buffer += "digraph blocktree {\n  rankdir=LR;\n  node [shape=box];\n";
+      auto label = [&blocks] (int first, int last, int count) {
+          if (count == 1) {
+              return blocks[first].id + "\\nheight " + std::to_string(blocks[first].height);
+          }
+          return blocks[first].id + " .. " + blocks[last].id + "\\nheights " + std::to_string(blocks[first].height)
+                 + "-" + std::to_string(blocks[last].height) + " (" + std::to_string(count) + " blocks)";
+      };
+      if (forksOnly) {
+          buffer += "  mainchain [label=\"main chain\\n" + std::to_string(mainChainLength) + " blocks\", style=filled];\n";
+      } else {
+          buffer += "  genesis [style=filled];\n";
+      }
+
+      // A run starts at a block whose parent does not have exactly
+      // one child, and follows the only child until that no longer holds.
+      std::vector<int> onlyChild (blocks.size(), -1);
+      for (int b = 0; b < numberOfBlocks; b++) {
+          int parent = blocks[b].parent;
+          if (parent >= 0 && children[parent] == 1) {
+              onlyChild[parent] = b;
+          }
+      }
+      std::vector<int> runOf (blocks.size(), -1); // the first block of each block's run
+      for (int b = 0; b < numberOfBlocks; b++) {
+          int parent = blocks[b].parent;
+          if (parent >= 0 && children[parent] == 1) {
+              continue; // inside a run
+          }
+          if (forksOnly && blocks[b].mainChain) {
+              continue;
+          }
+          int last = b;
+          int count = 1;
+          runOf[b] = b;
+          while (onlyChild[last] >= 0) {
+              last = onlyChild[last];
+              runOf[last] = b;
+              count++;
+          }
+          buffer += "  b" + std::to_string(b) + " [label=\"" + label(b, last, count) + "\"";
+          buffer += blocks[b].mainChain ? ", style=filled];\n" : "];\n";
+          flush(false);
+      }
+      for (int b = 0; b < numberOfBlocks; b++) {
+          int parent = blocks[b].parent;
+          if (runOf[b] != b) {
+              continue;
+          }
+          if (forksOnly && (parent < 0 || blocks[parent].mainChain)) {
+              // a fork, labelled with the main chain block it leaves from
+              std::string from = parent < 0 ? blocks[b].previousId : blocks[parent].id;
+              buffer += "  mainchain -> b" + std::to_string(b) + " [label=\"" + from + "\"];\n";
+          } else if (parent >= 0) {
+              buffer += "  b" + std::to_string(runOf[parent]) + " -> b" + std::to_string(b) + ";\n";
+          } else {
+              buffer += "  genesis -> b" + std::to_string(b) + ";\n";
+          }
+          flush(false);
+      }
+      buffer += "}\n";
+  }
+  flush(true);
+  out.close();
+}
+
 /**
  * Install the Blockchain simulator application onto a node
  * \param neighbourIps The ips of the node's neighbours
@@ -167,6 +1536,7 @@ void installBCS(
     double blockReward,
     int testGetDataTimeoutVictim,
     bool testGetDataTimeout) {
+  BCS_PROFILE_SCOPE ("setup: install BCSBC app");
   BCSHelper BCSapp (blockChainType);
   BCSapp.SetUpListeningSocket(TCP, port);
   BCSapp.SetAttribute ("nodeID", UintegerValue (nodeNumber));
@@ -230,6 +1600,10 @@ main (int argc, char *argv[])
   std::string bcConnections = "";
   int topology = 1;
   int minConnectionsPerNode = -1;
+  std::string topologyModel = "minConnections";
+  int maxInboundConnections = 125;
+  uint32_t topologySeed = 0;
+  std::string topologyFile = "";
 
   std::string delay = "10ms";
   std::string dataRate = "25Mbps";
@@ -246,6 +1620,9 @@ main (int argc, char *argv[])
   std::string routerIpAddresses = "";
   
   std::string protocol = "TCP";
+  std::string routing = "global";
+  int64_t seed = -1; // -1 if not given
+  int64_t run = -1; // -1 if not given
   int endTime = 500;
   int getDataTimeout = 30;
 
@@ -272,6 +1649,18 @@ main (int argc, char *argv[])
 
   int debugMessages = 0;
 
+  int distributed = 0;
+
+  int animation = 0;
+  std::string animationFile = "blockSim.xml";
+  double animationStart = 0;
+  double animationStop = -1;
+  int animationPackets = 1;
+  uint64_t animationPacketsPerFile = 0;
+
+  std::string blockTree = "";
+  int blockTreeForksOnly = 0;
+
   // number of nodes and routers
   cmd.AddValue("nodes", "\nThe number of nodes.\nExample: 4.\nDefault: 2.\n", numberOfNodes);
   cmd.AddValue("routers", "\nThe number of routers.\nExample: 2.\nDefault: 0.\n", numberOfRouters);
@@ -281,6 +1670,10 @@ main (int argc, char *argv[])
   cmd.AddValue("bcConnections", "\nThe blockchain network peer to peer connections.\nNodes represented by n followed by the node number.\nNodes are numbered starting from 0.\nComma separated.\nExample: 'n0-n1,n1-n2,n2-n3'.\nDefault: 'n0-n1' if links and bcConnections are not provided.\nAlternatively, it will be set equal to the links if links are provided and bcConnections are not provided.\n", bcConnections);
   cmd.AddValue("topology", "\nUse a provided topology.\nSee topologies.txt for options.\nExample: 1.\nDefault: 1.\n", topology);
   cmd.AddValue("minConnectionsPerNode", "\nThe minimum number of connections per node.\nIf specified, the links will be generated by the simulator.\nExample: 6.\nDefault: None. Not using a generated topology.\n", minConnectionsPerNode);
+  cmd.AddValue("topologyModel", "\nThe model used to generate the topology when minConnectionsPerNode is specified.\nminConnections: a ring plus random links until every node has minConnectionsPerNode connections.\nregular: every node has exactly minConnectionsPerNode random connections (at least 3).\nerdos-renyi: random links with an average of minConnectionsPerNode connections per node.\nbarabasi-albert: preferential attachment, each new node makes minConnectionsPerNode links.\nbitcoin: every node opens minConnectionsPerNode outbound connections to peers with fewer than maxInboundConnections inbound connections.\nExample: 'bitcoin'.\nDefault: 'minConnections'.\n", topologyModel);
+  cmd.AddValue("maxInboundConnections", "\nThe maximum number of inbound connections of a node in the bitcoin topology model.\nExample: 50.\nDefault: 125.\n", maxInboundConnections);
+  cmd.AddValue("topologyFile", "\nRead the nodes, routers, links (with delays and data rates) and bcConnections from a file.\nOne entry per line: 'nodes <number>', 'routers <number>', 'link <from> <to> [delay] [data rate]', 'connection <node> <node>'.\nIf there are no connection lines, the links are also the bcConnections.\nExample: 'topology.txt'.\nDefault: None. Use the command line topology.\n", topologyFile);
+  cmd.AddValue("topologySeed", "\nThe seed of the topology generator. The same seed generates the same topology.\nExample: 7.\nDefault: The seed, so runs with the same seed and a different run number share a topology.\n", topologySeed);
 
   // delays and data rates
   cmd.AddValue("delay", "\nLinks delay.\nExample: '500ms'.\nDefault: '10ms'.\n", delay);
@@ -290,8 +1683,11 @@ main (int argc, char *argv[])
 
   // misc simulator configurable parameters
   cmd.AddValue("protocol", "\nProtocol to use in sockets - TCP or UDP.\nExample: 'UDP'.\nDefault: 'TCP'.\n", protocol);
+  cmd.AddValue("routing", "\nHow routing tables are set up - global or peer.\nglobal: ns-3 global routing, routes between every pair of nodes and routers.\npeer: static routes along fewest hop paths, only between nodes with bcConnections. Scales with the number of connections for large router meshes.\nExample: 'peer'.\nDefault: 'global'.\n", routing);
   cmd.AddValue("endTime", "\nThe simulation end time in seconds.\nExample: 100.\nDefault: 500.\n", endTime);
   cmd.AddValue("getDataTimeout", "\nThe get data timeout in seconds.\nExample: 10.\nDefault: 30.\n", getDataTimeout);
+  cmd.AddValue("seed", "\nThe seed of all random numbers in the simulation (ns-3 RngSeedManager).\nThe same seed, run and parameters give the same simulation.\nExample: 3.\nDefault: ns-3's RngSeed (1 unless --RngSeed is given).\n", seed);
+  cmd.AddValue("run", "\nThe run number (ns-3 RngSeedManager).\nRuns with the same seed use independent random number streams, use it for replications.\nExample: 2.\nDefault: ns-3's RngRun (1 unless --RngRun is given).\n", run);
   
   // hash powers of the nodes
   cmd.AddValue("hashPowers", "\nHash powers of the nodes.\nCan use any unit to quantify hash power as long as it is consistent.\nIf a node is not a miner hash power is 0.\nExample: '23,0,12'\nDefault: All nodes have hash power of 10 units.\n", hashPowers);
@@ -330,10 +1726,71 @@ main (int argc, char *argv[])
   cmd.AddValue("testCompactBlockTransaction", "\nTest the compact block transaction related messages?\n0 for false, 1 for true.\nExample: 1.\nDefault: 0.\n", testCompactBlockTransaction);
   // debug mode on
   cmd.AddValue("debug", "\nOutput debug messages?\n0 for false, 1 for true.\nExample: 1.\nDefault: 0.\n", debugMessages);
+  // NetAnim
+  cmd.AddValue("animation", "\nWrite a NetAnim animation of the simulation?\n0 for false, 1 for true.\nExample: 1.\nDefault: 0.\n", animation);
+  cmd.AddValue("animationFile", "\nThe NetAnim animation file.\nExample: 'run1.xml'.\nDefault: 'blockSim.xml'.\n", animationFile);
+  cmd.AddValue("animationStart", "\nThe time in seconds packets start being recorded in the animation.\nExample: 100.\nDefault: 0.\n", animationStart);
+  cmd.AddValue("animationStop", "\nThe time in seconds packets stop being recorded in the animation.\nExample: 200.\nDefault: None. Recorded until the end time.\n", animationStop);
+  cmd.AddValue("animationPackets", "\nRecord packets in the animation?\nIf not, only the nodes and links are written.\n0 for false, 1 for true.\nExample: 0.\nDefault: 1.\n", animationPackets);
+  cmd.AddValue("animationPacketsPerFile", "\nThe number of packets written to an animation file before starting the next file\n(animationFile-1, animationFile-2, ...).\nExample: 100000.\nDefault: None. Everything is written to one file.\n", animationPacketsPerFile);
+  // block tree export
+  cmd.AddValue("blockTree", "\nWrite the block tree at the end of the simulation - edges or dot.\nedges: BCSBCOutput/Block tree.csv, one row per block with its height.\ndot: BCSBCOutput/Block tree.dot, GraphViz with linear runs of blocks collapsed.\nExample: 'dot'.\nDefault: None. Only BCSBCOutput/printblockchain.py is written.\n", blockTree);
+  cmd.AddValue("blockTreeForksOnly", "\nOnly write the forks and the main chain blocks they leave from to the block tree?\n0 for false, 1 for true.\nExample: 1.\nDefault: 0.\n", blockTreeForksOnly);
+  // distributed simulation
+  cmd.AddValue("distributed", "\nRun as a distributed simulation over MPI?\nThe nodes and routers are partitioned between the MPI ranks.\nRequires ns-3 to be built with MPI. Start with mpirun.\n0 for false, 1 for true.\nExample: 1.\nDefault: 0.\n", distributed);
   
   cmd.Parse (argc, argv);
 
   Time::SetResolution (Time::NS);
+
+  // Every random number in the simulation comes from the seed and run:
+  // the ns-3 random variables of the applications, and the topology
+  // generator unless it is given its own seed.
+  // --seed and --run only override ns-3's own --RngSeed and --RngRun
+  // (already applied by Parse) when they are given.
+  if (seed != -1) {
+      if (seed < 1 || seed > UINT32_MAX) {
+          std::cerr << "Seed must be between 1 and " << UINT32_MAX << std::endl;
+          return 1;
+      }
+      RngSeedManager::SetSeed (seed);
+  }
+  if (run != -1) {
+      if (run < 0) {
+          std::cerr << "Run number cannot be negative" << std::endl;
+          return 1;
+      }
+      RngSeedManager::SetRun (run);
+  }
+  seed = RngSeedManager::GetSeed ();
+  run = RngSeedManager::GetRun ();
+  if (topologySeed == 0) {
+      topologySeed = seed;
+  }
+
+  // Wall clock time of each setup phase, reported before the simulation starts
+  std::vector<std::pair<std::string, double>> setupTimes;
+  auto phaseStart = std::chrono::steady_clock::now();
+
+  // The rank of this process and the number of ranks
+  // (0 and 1 when not distributed)
+  uint32_t systemId = 0;
+  uint32_t systemCount = 1;
+#ifdef NS3_MPI
+  std::unique_ptr<MpiGuard> mpiGuard;
+#endif
+  if (distributed != 0) {
+#ifdef NS3_MPI
+      GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DistributedSimulatorImpl"));
+      MpiInterface::Enable (&argc, &argv);
+      mpiGuard.reset (new MpiGuard ());
+      systemId = MpiInterface::GetSystemId ();
+      systemCount = MpiInterface::GetSize ();
+#else
+      std::cerr << "Distributed simulation requires ns-3 to be built with MPI" << std::endl;
+      return 1;
+#endif
+  }
   
   if (debugMessages != 0) {
     TestTransaction();
@@ -347,7 +1804,9 @@ main (int argc, char *argv[])
     LogComponentEnable ("BCSBCApplication", LOG_LEVEL_INFO);
     LogComponentEnable ("BLOCKCHAIN", LOG_LEVEL_INFO);
   }
-  cleanOutputFiles();
+  if (systemId == 0) {
+      cleanOutputFiles();
+  }
 
   // Checking protocol is valid
   bool TCP = true;
@@ -362,6 +1821,16 @@ main (int argc, char *argv[])
       TCP = false;
   }
 
+  if (routing != "global" && routing != "peer") {
+      NS_LOG_INFO ("Routing must be global or peer");
+      return 1;
+  }
+
+  if (blockTree != "" && blockTree != "edges" && blockTree != "dot") {
+      NS_LOG_INFO ("Block tree must be edges or dot");
+      return 1;
+  }
+
   if (numberOfNodes < 2) {
       NS_LOG_INFO ("Number of nodes cannot be less than two");
       return 1;
@@ -421,6 +1890,34 @@ main (int argc, char *argv[])
       }
   }
   
+  // Use a topology file
+  TopologyFile topologyFileData;
+  bool loaded = false;
+  if (topologyFile != "") {
+      if (minConnectionsPerNode > -1) {
+          std::cerr << "Cannot use a topology file and generate a topology" << std::endl;
+          return 1;
+      }
+      if (delays.length() > 0 || dataRates.length() > 0) {
+          std::cerr << "Per link delays and data rates must be given in the topology file" << std::endl;
+          return 1;
+      }
+      // topology is checked first as a provided topology sets the others
+      if (topology != 1 || numberOfNodes != 2 || numberOfRouters != 0 || links.length() > 0 || bcConnections.length() > 0) {
+          std::cerr << "Nodes, routers, links and bcConnections must be given in the topology file, not with --nodes, --routers, --links, --bcConnections or --topology" << std::endl;
+          return 1;
+      }
+      std::cout << "Loading topology file" << std::endl;
+      if (!loadTopologyFile(topologyFile, topologyFileData)) {
+          return 1;
+      }
+      loaded = true;
+      numberOfNodes = topologyFileData.numberOfNodes;
+      numberOfRouters = topologyFileData.numberOfRouters;
+      links = "";
+      bcConnections = "";
+  }
+
   // Checking minimum connections per node is valid (if it has been provided)
   if (minConnectionsPerNode > -1) {
       if ((numberOfNodes != 2) && minConnectionsPerNode < 2) {
@@ -435,65 +1932,60 @@ main (int argc, char *argv[])
           NS_LOG_INFO ("The largest number of connections per node is one less than the number of nodes");
           return 1;
       }
+      if (topologyModel != "minConnections" && topologyModel != "regular" && topologyModel != "erdos-renyi"
+          && topologyModel != "barabasi-albert" && topologyModel != "bitcoin") {
+          NS_LOG_INFO ("There is no topology model " + topologyModel);
+          return 1;
+      }
+      if (topologyModel == "regular" && minConnectionsPerNode < 3) {
+          NS_LOG_INFO ("A regular topology needs at least 3 connections per node to be connected");
+          return 1;
+      }
+      if (topologyModel == "regular" && ((long) numberOfNodes * minConnectionsPerNode) % 2 != 0) {
+          NS_LOG_INFO ("The number of nodes times the connections per node must be even for a regular topology");
+          return 1;
+      }
+      if (topologyModel == "bitcoin" && maxInboundConnections < 1) {
+          NS_LOG_INFO ("Maximum inbound connections must be at least 1");
+          return 1;
+      }
   }
 
   // User wants to generate a topology based on node number and minimum connections per node
+  // The generated links are used as both the links and the bcConnections
+  GeneratedTopology generatedTopology;
+  bool generated = false;
   if (minConnectionsPerNode > -1) {
-      std::unordered_map<int,std::unordered_map<int,int>> allLinks; // to make sure that do not duplicate a link
-      // key is a nodes number, value is a map of nodes connected to that node.
-      links = "";
-      int i = 0;
-      while (i < numberOfNodes) {
-          // do this to make sure graph is connected
-          if (i == numberOfNodes - 1) {
-            if (allLinks[i].count(0) == 0) {
-                links += "n"+std::to_string(i) + "-n" + std::to_string(0) + ",";
-                allLinks[i][0] = 0;
-                allLinks[0][i] = i;
-            }
-          } else {
-            if (allLinks[i].count(i+1) == 0) {
-                links += "n"+std::to_string(i) + "-n" + std::to_string(i+1) + ",";
-                allLinks[i][i+1] = i+1;
-                allLinks[i+1][i] = i;
-            }
-          }
-          i++;
-      }
-      i = 0;
-      while (i < numberOfNodes) {
-          if (minConnectionsPerNode > 2) {
-            std::unordered_map<int, int> nodesToConnectTo = allLinks[i];
-            int j = nodesToConnectTo.size();
-
-            while (j < (minConnectionsPerNode)) {
-                // choose a random node to connect to
-                int randomInt = (rand() % numberOfNodes);
-                while ((randomInt == i)|| (randomInt == (i+1)%numberOfNodes)
-                        || (nodesToConnectTo.count(randomInt) == 1)) {
-                    // must connect to different nodes and not itself
-                    randomInt = (rand() % numberOfNodes);
-                }
-                nodesToConnectTo[randomInt] = randomInt;
-                allLinks[i][randomInt] = randomInt;
-                allLinks[randomInt][i] = i;
-                // add to the links string
-                links.append("n"+std::to_string(i) + "-n" + std::to_string(randomInt) + ",");
-                j++;
-            }
+      BCS_PROFILE_SCOPE ("setup: generate topology");
+      std::mt19937 topologyRng (topologySeed);
+      if (topologyModel == "regular") {
+          if (!generateRandomRegularTopology(generatedTopology, numberOfNodes, minConnectionsPerNode, topologyRng)) {
+              NS_LOG_INFO ("Could not generate a regular topology, try a different topologySeed");
+              return 1;
           }
-          i++;
+      } else if (topologyModel == "erdos-renyi") {
+          generateErdosRenyiTopology(generatedTopology, numberOfNodes, minConnectionsPerNode, topologyRng);
+      } else if (topologyModel == "barabasi-albert") {
+          generateBarabasiAlbertTopology(generatedTopology, numberOfNodes, minConnectionsPerNode, topologyRng);
+      } else if (topologyModel == "bitcoin") {
+          generateBitcoinTopology(generatedTopology, numberOfNodes, minConnectionsPerNode, maxInboundConnections, topologyRng);
+      } else {
+          generateMinConnectionsTopology(generatedTopology, numberOfNodes, minConnectionsPerNode, topologyRng);
       }
-      links.erase(links.size()-1);
-      bcConnections = links;
+      finishGeneratedTopology(generatedTopology);
+      generated = true;
+      links = "";
+      bcConnections = "";
       numberOfRouters=0;
       int m = 0;
       std::cout << "The generated topology:" << std::endl;
-      while (m < allLinks.size()) {
+      while (m < numberOfNodes) {
           std::string message = "Node " + std::to_string(m) + " is connected to the following nodes: ";
-          for (auto& it: allLinks[m]) {
-              message+= std::to_string(it.first);
+          int k = generatedTopology.neighbourOffsets[m];
+          while (k < generatedTopology.neighbourOffsets[m + 1]) {
+              message+= std::to_string(generatedTopology.neighbours[k]);
               message+= ", ";
+              k++;
           }
           message.erase(message.size()-2);
           std::cout << message << std::endl;
@@ -523,6 +2015,9 @@ main (int argc, char *argv[])
       same = true;
       bcConnections = links;
   }
+  if (loaded) {
+      same = topologyFileData.connections.empty();
+  }
 
   // Check testGetDataTimeoutAttacker and testGetDataTimeoutVictim if they 
   // have been provided
@@ -594,6 +2089,21 @@ main (int argc, char *argv[])
       NS_LOG_INFO ("Average transaction creation interval cannot be less than or equal to 0");
       return 1;
   }
+  // check the animation options
+  if (animation != 0) {
+      if (distributed != 0) {
+          NS_LOG_INFO ("NetAnim does not support distributed simulations");
+          return 1;
+      }
+      if (animationStart < 0) {
+          NS_LOG_INFO ("Animation start cannot be less than 0");
+          return 1;
+      }
+      if (animationStop >= 0 && animationStop <= animationStart) {
+          NS_LOG_INFO ("Animation stop must be after animation start");
+          return 1;
+      }
+  }
   // check that the block reward is greater than 0
   if (blockReward <= 0) {
       NS_LOG_INFO ("Block reward cannot be less than or equal to 0");
@@ -603,10 +2113,21 @@ main (int argc, char *argv[])
   // Split the string inputs that require splitting
   std::vector<std::string > linkSubStrings = stringSplit(links, ',');
   int numberOfLinks = linkSubStrings.size();
+  if (generated) {
+      numberOfLinks = generatedTopology.links.size();
+  }
+  if (loaded) {
+      numberOfLinks = topologyFileData.links.size();
+  }
   std::vector<std::string > bcConnectionsVector = stringSplit(bcConnections, ',');
 
   std::vector<std::string > delaysVector = stringSplit(delays, ',');
   std::vector<std::string > dataRatesVector = stringSplit(dataRates, ',');
+  if (loaded) {
+      // "" for links using the default delay or data rate
+      delaysVector.swap(topologyFileData.linkDelays);
+      dataRatesVector.swap(topologyFileData.linkDataRates);
+  }
 
   std::vector<std::string > hashPowersVector = stringSplit(hashPowers, ',');
 
@@ -744,53 +2265,18 @@ main (int argc, char *argv[])
           y++;
       }
   }
-  std::cout << "Creating network topology" << std::endl;
-
-  if (numberOfRouters > 0) {
-      std::cout << "Creating nodes and routers" << std::endl;
-  } else {
-      std::cout << "Creating nodes" << std::endl;
-  }
-  // Create the nodes and routers
-  // Note that ns-3 terminology refers to both nodes and routers as nodes
-  NS_LOG_INFO ("Creating nodes and routers");
-  NodeContainer nodes;
-  NS_LOG_INFO ("Creating " + std::to_string(numberOfNodes) + " nodes");
-  NS_LOG_INFO ("Creating " + std::to_string(numberOfRouters) + " routers");
-  nodes.Create (numberOfNodes + numberOfRouters);
-  InternetStackHelper internet;
-  internet.Install (nodes);
-  
-  int m = 0;
-
-  // This gives the ip addresses of nodes that are
-  // connected to a node in the bitcoin network
-  //e.g. nodeConnections.at(0) provides a vector of IP addresses that 
-  //are connected to node 0.
-  std::vector<std::vector<Ipv4Address>> nodeConnections;
-
-  // Contains the ips of each node (and router)
-  // e.g. nodeIps.at(0) is a vector of IP address that node 0 has
-  std::vector<std::vector<Ipv4Address>> nodeIps;
-
-  // Contains a map of ip address to associated node number
-  std::unordered_map<uint32_t, int> ipNodeNumberMap;
 
-  int n = 0;
-  
-  while (n < (numberOfNodes+numberOfRouters)) {
-      std::vector<Ipv4Address> connections;
-      nodeConnections.push_back(connections);
-      std::vector<Ipv4Address> ips;
-      nodeIps.push_back(ips);
-      n++;
+  // Parse the links before creating the nodes, so that
+  // the topology is known when partitioning it
+  // (generated links do not need parsing)
+  std::vector<std::pair<int, int>> linkEndpoints;
+  if (generated) {
+      linkEndpoints.swap(generatedTopology.links);
+  } else if (loaded) {
+      linkEndpoints.swap(topologyFileData.links);
   }
-
-  std::cout << "Creating links" << std::endl;
-  Ipv4AddressHelper ipv4; 
-  ipv4.SetBase ("10.0.0.0", "255.255.255.255", "0.0.0.0");
   int j = 0;
-  while (j < numberOfLinks) {
+  while (!generated && !loaded && j < numberOfLinks) {
 
     NS_LOG_INFO ("Attempting to create a link between:");
     std::vector<std::string > nodesVector = stringSplit(linkSubStrings[j], '-');
@@ -850,51 +2336,185 @@ main (int argc, char *argv[])
         }
     }
 
+    linkEndpoints.push_back(std::make_pair(values[0], values[1]));
+    j++;
+  }
+
+  setupTimes.push_back(std::make_pair("topology description", secondsSince(phaseStart)));
+  phaseStart = std::chrono::steady_clock::now();
+
+  std::cout << "Creating network topology" << std::endl;
+
+  if (numberOfRouters > 0) {
+      std::cout << "Creating nodes and routers" << std::endl;
+  } else {
+      std::cout << "Creating nodes" << std::endl;
+  }
+  // Create the nodes and routers
+  // Note that ns-3 terminology refers to both nodes and routers as nodes
+  NS_LOG_INFO ("Creating nodes and routers");
+  NodeContainer nodes;
+  NS_LOG_INFO ("Creating " + std::to_string(numberOfNodes) + " nodes");
+  NS_LOG_INFO ("Creating " + std::to_string(numberOfRouters) + " routers");
+  if (systemCount > 1) {
+      if (systemCount > (uint32_t) (numberOfNodes + numberOfRouters)) {
+          std::cerr << "Cannot partition " << (numberOfNodes + numberOfRouters) << " nodes and routers between "
+                    << systemCount << " ranks, every rank needs at least one" << std::endl;
+          return 1;
+      }
+      // Every rank builds the whole topology, each node
+      // is only simulated by the rank it is partitioned to
+      std::vector<double> linkDelays;
+      j = 0;
+      while (j < numberOfLinks) {
+          if (!delaysVector.empty() && !delaysVector[j].empty()) {
+              linkDelays.push_back(Time (delaysVector[j]).GetSeconds());
+          } else {
+              linkDelays.push_back(Time (delay).GetSeconds());
+          }
+          j++;
+      }
+      std::vector<uint32_t> partition = partitionTopology(numberOfNodes + numberOfRouters, linkEndpoints, linkDelays, systemCount);
+
+      int cutLinks = 0;
+      double lookahead = -1;
+      j = 0;
+      while (j < numberOfLinks) {
+          if (partition[linkEndpoints[j].first] != partition[linkEndpoints[j].second]) {
+              cutLinks++;
+              if (lookahead < 0 || linkDelays[j] < lookahead) {
+                  lookahead = linkDelays[j];
+              }
+          }
+          j++;
+      }
+      if (systemId == 0) {
+          std::cout << "Partitioned " << (numberOfNodes + numberOfRouters) << " nodes and routers between "
+                    << systemCount << " ranks with " << cutLinks << " links between ranks";
+          if (cutLinks > 0) {
+              std::cout << " and a lookahead of " << lookahead << "s";
+          }
+          std::cout << std::endl;
+      }
+
+      int v = 0;
+      while (v < (numberOfNodes + numberOfRouters)) {
+          nodes.Create (1, partition[v]);
+          v++;
+      }
+  } else {
+      nodes.Create (numberOfNodes + numberOfRouters);
+  }
+  InternetStackHelper internet;
+  internet.Install (nodes);
+
+  setupTimes.push_back(std::make_pair("nodes", secondsSince(phaseStart)));
+  phaseStart = std::chrono::steady_clock::now();
+
+  // Count the links of each node (and router) so the
+  // per node vectors below are only allocated once
+  std::vector<int> linksPerNode (numberOfNodes + numberOfRouters, 0);
+  for (const auto &link : linkEndpoints) {
+      linksPerNode[link.first]++;
+      linksPerNode[link.second]++;
+  }
+
+  // This gives the ip addresses of nodes that are
+  // connected to a node in the bitcoin network
+  //e.g. nodeConnections.at(0) provides a vector of IP addresses that 
+  //are connected to node 0.
+  std::vector<std::vector<Ipv4Address>> nodeConnections (numberOfNodes + numberOfRouters);
+
+  // Contains the ips of each node (and router)
+  // e.g. nodeIps.at(0) is a vector of IP address that node 0 has
+  std::vector<std::vector<Ipv4Address>> nodeIps (numberOfNodes + numberOfRouters);
+
+  // Contains a map of ip address to associated node number
+  std::unordered_map<uint32_t, int> ipNodeNumberMap;
+  ipNodeNumberMap.reserve(2 * numberOfLinks);
+
+  int n = 0;
+  while (n < (numberOfNodes+numberOfRouters)) {
+      nodeIps.at(n).reserve(linksPerNode[n]);
+      if (same) {
+          nodeConnections.at(n).reserve(linksPerNode[n]);
+      }
+      n++;
+  }
+
+  std::cout << "Creating links" << std::endl;
+  // Links with the same data rate and delay share a helper,
+  // so the attributes are only parsed once per combination
+  std::unordered_map<std::string, PointToPointHelper> p2pHelpers;
+  // The two devices of every link, in link order
+  NetDeviceContainer linkDevices;
+  j = 0;
+  while (j < numberOfLinks) {
+    BCS_PROFILE_SCOPE ("setup: install link");
+
+    int values[2] = {linkEndpoints[j].first, linkEndpoints[j].second};
+
     // create the links with chosen datarate and delay
-    NodeContainer nodeContainer = NodeContainer (nodes.Get (values[0]), nodes.Get (values[1]));
-    PointToPointHelper p2p;
-    if (dataRates.length() != 0) {
-        NS_LOG_INFO ("with data rate = " + dataRatesVector[j]);
-        p2p.SetDeviceAttribute ("DataRate", StringValue (dataRatesVector[j]));
-    } else {
-        NS_LOG_INFO ("with data rate = " + dataRate);
-        p2p.SetDeviceAttribute ("DataRate", StringValue (dataRate));
+    std::string linkDataRate = dataRate;
+    if (!dataRatesVector.empty() && !dataRatesVector[j].empty()) {
+        linkDataRate = dataRatesVector[j];
     }
-
-    if (delays.length() != 0) {
-        NS_LOG_INFO ("with delay = " + delaysVector[j]);
-        p2p.SetChannelAttribute ("Delay", StringValue (delaysVector[j]));
-    } else {
-        NS_LOG_INFO ("with delay = " + delay);
-        p2p.SetChannelAttribute ("Delay", StringValue (delay));
+    std::string linkDelay = delay;
+    if (!delaysVector.empty() && !delaysVector[j].empty()) {
+        linkDelay = delaysVector[j];
+    }
+    NS_LOG_INFO ("Creating a link between " + std::to_string(values[0]) + " and " + std::to_string(values[1])
+                 + " with data rate = " + linkDataRate + " and delay = " + linkDelay);
+
+    std::string helperKey = linkDataRate + " " + linkDelay;
+    auto p2p = p2pHelpers.find(helperKey);
+    if (p2p == p2pHelpers.end()) {
+        PointToPointHelper helper;
+        helper.SetDeviceAttribute ("DataRate", StringValue (linkDataRate));
+        helper.SetChannelAttribute ("Delay", StringValue (linkDelay));
+        p2p = p2pHelpers.emplace(helperKey, helper).first;
     }
 
     // Install a point to point connection between the two nodes (or router/s)
-    // in the node container
-    NetDeviceContainer netDevice = p2p.Install (nodeContainer);
+    linkDevices.Add (p2p->second.Install (nodes.Get (values[0]), nodes.Get (values[1])));
+
+    j++;
+  }
+
+  // Install an IPv4 address on the nodes/routers
+  // ns-3 will chose an ip address and assign it starting from 
+  // the base provided, one device after the other, so
+  // assigning all devices at once gives the same addresses
+  // as assigning them link by link
+  Ipv4AddressHelper ipv4; 
+  ipv4.SetBase ("10.0.0.0", "255.255.255.255", "0.0.0.0");
+  Ipv4InterfaceContainer linkInterfaces;
+  {
+      BCS_PROFILE_SCOPE ("setup: assign addresses");
+      linkInterfaces = ipv4.Assign (linkDevices);
+  }
+  BCS_PROFILE_COUNT ("links", numberOfLinks);
 
-    // Install an IPv4 address on the nodes/routers
-    // ns-3 will chose an ip address and assign it starting from 
-    // the base provided previously
-    NetDeviceContainer netDevice1 = NetDeviceContainer (netDevice.Get(0));
-    NetDeviceContainer netDevice2 = NetDeviceContainer (netDevice.Get(1));
-    Ipv4InterfaceContainer interface1 = ipv4.Assign (netDevice1);
-    Ipv4InterfaceContainer interface2 = ipv4.Assign (netDevice2);
+  j = 0;
+  while (j < numberOfLinks) {
+
+    int values[2] = {linkEndpoints[j].first, linkEndpoints[j].second};
+    Ipv4Address address1 = linkInterfaces.GetAddress(2 * j);
+    Ipv4Address address2 = linkInterfaces.GetAddress(2 * j + 1);
 
     if (same) {
         // bcconnections is the same as the links
-        (nodeConnections.at(values[0])).push_back(interface2.GetAddress(0));
-        (nodeConnections.at(values[1])).push_back(interface1.GetAddress(0));
+        (nodeConnections.at(values[0])).push_back(address2);
+        (nodeConnections.at(values[1])).push_back(address1);
     }
 
-    (nodeIps.at(values[0])).push_back(interface1.GetAddress(0));
-    (nodeIps.at(values[1])).push_back(interface2.GetAddress(0));
+    (nodeIps.at(values[0])).push_back(address1);
+    (nodeIps.at(values[1])).push_back(address2);
 
-    ipNodeNumberMap[interface1.GetAddress(0).Get()] = values[0];
-    ipNodeNumberMap[interface2.GetAddress(0).Get()] = values[1];
+    ipNodeNumberMap[address1.Get()] = values[0];
+    ipNodeNumberMap[address2.Get()] = values[1];
 
     j++;
-    m+=2;
   }
 
   j = 0;
@@ -903,7 +2523,11 @@ main (int argc, char *argv[])
   // only need to do this, if the bcConnections string is
   // different from the links string
   if (!same) {
-    while (j < numberOfConnections) {
+    std::vector<std::pair<int, int>> connectionEndpoints;
+    if (loaded) {
+        connectionEndpoints.swap(topologyFileData.connections);
+    }
+    while (!loaded && j < numberOfConnections) {
 
         NS_LOG_INFO ("Attempting to create a connection between:");
         std::vector<std::string> nodesVector = stringSplit(bcConnectionsVector[j], '-');
@@ -942,19 +2566,68 @@ main (int argc, char *argv[])
             return 1; 
         }
 
-        // add these to the node connections list
-        (nodeConnections.at(values[0])).push_back((nodeIps.at(values[1]).at(0)));
-        (nodeConnections.at(values[1])).push_back((nodeIps.at(values[0]).at(0)));
-
+        connectionEndpoints.push_back(std::make_pair(values[0], values[1]));
         j++;
     }
+
+    for (const auto &connection : connectionEndpoints) {
+        if (nodeIps.at(connection.first).empty() || nodeIps.at(connection.second).empty()) {
+            std::cerr << "Cannot create a connection with node " << (nodeIps.at(connection.first).empty() ? connection.first : connection.second) << " which has no links" << std::endl;
+            return 1;
+        }
+        // add these to the node connections list
+        (nodeConnections.at(connection.first)).push_back((nodeIps.at(connection.second).at(0)));
+        (nodeConnections.at(connection.second)).push_back((nodeIps.at(connection.first).at(0)));
+    }
   }
+
+  setupTimes.push_back(std::make_pair("links", secondsSince(phaseStart)));
+  phaseStart = std::chrono::steady_clock::now();
+
   // Added in this log because routing table population
   // can take some time
   NS_LOG_INFO ("About to populate routing tables");
-  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+  if (routing == "peer") {
+      std::vector<uint32_t> linkAddresses (2 * numberOfLinks);
+      std::vector<uint32_t> linkInterfaceIndexes (2 * numberOfLinks);
+      j = 0;
+      while (j < 2 * numberOfLinks) {
+          int node = (j % 2 == 0) ? linkEndpoints[j / 2].first : linkEndpoints[j / 2].second;
+          linkAddresses[j] = linkInterfaces.GetAddress(j).Get();
+          linkInterfaceIndexes[j] = nodes.Get (node)->GetObject<Ipv4> ()->GetInterfaceForDevice (linkDevices.Get (j));
+          j++;
+      }
+      std::vector<std::vector<uint32_t>> peerAddresses (numberOfNodes);
+      n = 0;
+      while (n < numberOfNodes) {
+          for (const Ipv4Address &address : nodeConnections.at(n)) {
+              peerAddresses[n].push_back(address.Get());
+          }
+          n++;
+      }
+
+      std::vector<HostRoute> routes = computePeerRoutes(numberOfNodes + numberOfRouters, linkEndpoints,
+                                                        linkAddresses, linkInterfaceIndexes, peerAddresses, ipNodeNumberMap);
+      BCS_PROFILE_SCOPE ("setup: install peer routes");
+      BCS_PROFILE_COUNT ("host routes", routes.size());
+      Ipv4StaticRoutingHelper staticRoutingHelper;
+      std::vector<Ptr<Ipv4StaticRouting>> staticRouting (numberOfNodes + numberOfRouters);
+      for (const HostRoute &route : routes) {
+          if (!staticRouting[route.node]) {
+              staticRouting[route.node] = staticRoutingHelper.GetStaticRouting (nodes.Get (route.node)->GetObject<Ipv4> ());
+          }
+          staticRouting[route.node]->AddHostRouteTo (Ipv4Address (route.destination), route.interface);
+      }
+      std::cout << "Installed " << routes.size() << " routes for the bcConnections" << std::endl;
+  } else {
+      BCS_PROFILE_SCOPE ("setup: PopulateRoutingTables");
+      Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+  }
   NS_LOG_INFO ("Topology creation successful!");
 
+  setupTimes.push_back(std::make_pair("routing", secondsSince(phaseStart)));
+  phaseStart = std::chrono::steady_clock::now();
+
   NS_LOG_INFO ("Attempting to install BCS app on nodes");
 
   uint16_t thePort = 8333;
@@ -996,8 +2669,16 @@ main (int argc, char *argv[])
   
   std::cout << "Installing BCSBC app on nodes" << std::endl;
   int h = 0;
+  int localNodes = 0; // nodes simulated by this rank
   while (h < (numberOfNodes)) {
 
+    // In a distributed simulation the app is
+    // only installed by the rank simulating the node
+    if (nodes.Get (h)->GetSystemId () != systemId) {
+        h++;
+        continue;
+    }
+
     bool testGetDataTimeout=false;
     if (testGetDataTimeoutAttacker == h) {
         // This node is the attacker
@@ -1040,23 +2721,92 @@ main (int argc, char *argv[])
     testGetDataTimeoutVictim,
     testGetDataTimeout
     );
+    localNodes++;
     h++;
   }
 
   NS_LOG_INFO ("Finished installing BCS app on nodes");
 
+  setupTimes.push_back(std::make_pair("applications", secondsSince(phaseStart)));
+  double totalSetupTime = 0;
+  for (const auto &phase : setupTimes) {
+      totalSetupTime += phase.second;
+  }
+  std::cout << "Setup took " << totalSetupTime << "s:";
+  for (const auto &phase : setupTimes) {
+      std::cout << " " << phase.first << " " << phase.second << "s";
+  }
+  std::cout << std::endl;
+  long setupMemoryKb = peakMemoryKb();
+  std::cout << "Memory after setup: " << setupMemoryKb / 1024 << "MB" << std::endl;
+
   //AsciiTraceHelper ascii;
   //p2p.EnableAsciiAll (ascii.CreateFileStream ("mysim.tr"));
   //p2p.EnablePcapAll ("mysim");
   
-  std::cout << "Starting simulation" << std::endl;
-  AnimationInterface anim("blockSim.xml");
-  Simulator::Run ();
+  std::cout << "Starting simulation with seed " << seed << ", run " << run << std::endl;
+  // Only create the animation when asked for, AnimationInterface
+  // connects to every packet trace as soon as it is constructed
+  std::unique_ptr<AnimationInterface> anim;
+  if (animation != 0) {
+      anim.reset (new AnimationInterface (animationFile));
+      anim->SetStartTime (Seconds (animationStart));
+      if (animationStop >= 0) {
+          anim->SetStopTime (Seconds (animationStop));
+      }
+      if (animationPackets == 0) {
+          anim->SkipPacketTracing ();
+      }
+      if (animationPacketsPerFile > 0) {
+          anim->SetMaxPktsPerTraceFile (animationPacketsPerFile);
+      }
+  }
+  auto runStart = std::chrono::steady_clock::now();
+  {
+      BCS_PROFILE_SCOPE ("simulation: Simulator::Run");
+      Simulator::Run ();
+  }
+  double runTime = secondsSince(runStart);
+  uint64_t events = Simulator::GetEventCount ();
+  std::cout << "Simulated " << events << " events in " << runTime << "s ("
+            << (runTime > 0 ? events / runTime : 0.0) << " events per second)" << std::endl;
+  BCS_PROFILE_COUNT ("events", events);
+  BCS_PROFILE_COUNT ("nodes simulated by this rank", localNodes);
+
+  // The simulation's memory is mostly the transaction pools, block pools
+  // and blockchains each node keeps. The process peak is all that can be
+  // measured here, so the growth during the run is spread evenly over the
+  // nodes of this rank as an average, not measured node by node.
+  long runMemoryKb = peakMemoryKb();
+  std::cout << "Peak memory: " << runMemoryKb / 1024 << "MB, grew "
+            << std::max(0L, runMemoryKb - setupMemoryKb) / 1024 << "MB during the simulation, an average of "
+            << std::max(0L, runMemoryKb - setupMemoryKb) / std::max(1, localNodes) << "KB per node (whole process peak divided by "
+            << localNodes << " nodes)" << std::endl;
+
   Simulator::Destroy ();
 
-  std::ofstream myfile5("BCSBCOutput/printblockchain.py", std::ios::app);
-  myfile5 << "print_tree(genesis, horizontal=True)" << "\n";
-  myfile5.close();
+  if (systemId == 0) {
+      std::ofstream myfile5("BCSBCOutput/printblockchain.py", std::ios::app);
+      myfile5 << "print_tree(genesis, horizontal=True)" << "\n";
+      myfile5.close();
+
+      std::vector<MinedBlock> blocks;
+      if (readMinedBlocks(blocks)) {
+          int mainChainLength = markMainChain(blocks);
+          writeChainMetrics(blocks, mainChainLength, hashPowersIntsVector, totalHashPower);
+          if (blockTree != "") {
+              writeBlockTree(blocks, mainChainLength, blockTree, blockTreeForksOnly != 0);
+          }
+      } else {
+          NS_LOG_INFO ("Could not read BCSBCOutput/Mining events.csv");
+      }
+  }
+
+  BCS_PROFILE_REPORT ();
+
+#ifdef NS3_MPI
+  mpiGuard.reset ();
+#endif
 
   std::cout << "Simulation complete" << std::endl;
 
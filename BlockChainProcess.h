@@ -0,0 +1,111 @@
+/*
+ * Helpers shared by the tools that run BlockChainNetworkSim
+ * as child processes (BlockChainSweep and BlockChainBenchmark).
+ */
+
+#ifndef BLOCKCHAIN_PROCESS_H
+#define BLOCKCHAIN_PROCESS_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Split the string on a separator, keeping empty substrings out
+ *
+ * \param str The string to split
+ * \param separator The separator char
+ *
+ * \return a vector of substrings
+ */
+inline std::vector<std::string> splitNonEmpty (const std::string &str, char separator) {
+  std::vector<std::string> subStrings;
+  std::stringstream stream (str);
+  std::string subString;
+  while (std::getline(stream, subString, separator)) {
+      if (!subString.empty()) {
+          subStrings.push_back(subString);
+      }
+  }
+  return subStrings;
+}
+
+/**
+ * Work out the path of another scratch executable from our own.
+ * ns-3 names scratch executables ns3.<version>-<name>-<profile> and puts them
+ * in the same directory, so swap our own name for the other one.
+ *
+ * \param argv0 The path this program was started with
+ * \param ownName The scratch name of this program e.g. 'BlockChainSweep'
+ * \param otherName The scratch name of the other program e.g. 'BlockChainNetworkSim'
+ *
+ * \return the absolute path of the other program, or "" if it cannot be derived
+ */
+inline std::string siblingExecutablePath (const std::string &argv0, const std::string &ownName, const std::string &otherName) {
+  char resolved[PATH_MAX];
+  if (realpath(argv0.c_str(), resolved) == nullptr) {
+      return "";
+  }
+  std::string path (resolved);
+  std::string::size_type position = path.rfind(ownName);
+  if (position == std::string::npos) {
+      return "";
+  }
+  path.replace(position, ownName.size(), otherName);
+  return path;
+}
+
+/**
+ * Fork and exec the simulator in its own working directory.
+ * The BCSBC application writes to the relative directory BCSBCOutput/,
+ * so the directory is given the BCSBCOutput/Packets and BCSBCOutput/Log
+ * directories it expects, the command line is saved to command.txt and
+ * stdout and stderr go to stdout.txt.
+ *
+ * \param directory The working directory of the run
+ * \param args The absolute path of the simulator followed by its arguments
+ *
+ * \return the pid of the child, or -1 if it could not be started
+ */
+inline pid_t startSimulatorProcess (const std::string &directory, std::vector<std::string> args) {
+  std::filesystem::create_directories(directory + "/BCSBCOutput/Packets");
+  std::filesystem::create_directories(directory + "/BCSBCOutput/Log");
+
+  std::ofstream command (directory + "/command.txt");
+  for (const std::string &arg : args) {
+      command << arg << " ";
+  }
+  command << "\n";
+  command.close();
+
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+      argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  pid_t pid = fork();
+  if (pid != 0) {
+      return pid; // parent, or -1 if the fork failed
+  }
+  // child: only async-signal-safe calls from here on
+  if (chdir(directory.c_str()) != 0) {
+      _exit(126);
+  }
+  int out = open("stdout.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out >= 0) {
+      dup2(out, STDOUT_FILENO);
+      dup2(out, STDERR_FILENO);
+      close(out);
+  }
+  execv(argv[0], argv.data());
+  _exit(127);
+}
+
+#endif /* BLOCKCHAIN_PROCESS_H */
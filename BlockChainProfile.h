@@ -0,0 +1,91 @@
+/*
+ * Profiling timers and counters, compiled in when BCS_PROFILE is defined
+ * e.g. CXXFLAGS="-DBCS_PROFILE" ./ns3 configure
+ * BCS_PROFILE_SCOPE (name)    time the rest of the enclosing block
+ * BCS_PROFILE_COUNT (name, n) add n to a counter
+ * BCS_PROFILE_REPORT ()       print the timers and counters
+ * Without BCS_PROFILE they compile to nothing.
+ *
+ * The timers and counters are inline variables, so every translation
+ * unit of a program that includes this header adds to the same ones.
+ */
+
+#ifndef BLOCKCHAIN_PROFILE_H
+#define BLOCKCHAIN_PROFILE_H
+
+#ifdef BCS_PROFILE
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * The total time spent in a profiled scope and how often it was entered
+ */
+struct ProfileTimer {
+  double seconds = 0;
+  uint64_t calls = 0;
+};
+
+inline std::map<std::string, ProfileTimer> profileTimers;
+inline std::map<std::string, uint64_t> profileCounters;
+
+/**
+ * Adds the time from its construction to its destruction to a timer
+ */
+class ProfileScope {
+public:
+  ProfileScope (const char *name) : m_name (name), m_start (std::chrono::steady_clock::now()) {}
+  ~ProfileScope () {
+    ProfileTimer &timer = profileTimers[m_name];
+    timer.seconds += std::chrono::duration<double> (std::chrono::steady_clock::now() - m_start).count();
+    timer.calls++;
+  }
+private:
+  const char *m_name;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * Print the profile as a table, slowest first, then the counters.
+ * The events per wall clock second are worked out from the
+ * "events" counter and the Simulator::Run timer.
+ */
+inline void profileReport () {
+  std::vector<std::pair<std::string, ProfileTimer>> timers (profileTimers.begin(), profileTimers.end());
+  std::sort(timers.begin(), timers.end(), [] (const std::pair<std::string, ProfileTimer> &a, const std::pair<std::string, ProfileTimer> &b) {
+      return a.second.seconds > b.second.seconds;
+  });
+  std::cout << "Profile:" << std::endl;
+  std::cout << "  Seconds      Calls  Microseconds/call  Scope" << std::endl;
+  for (const auto &timer : timers) {
+      char line[64];
+      snprintf(line, sizeof(line), "%9.3f %10llu %18.3f  ", timer.second.seconds,
+               (unsigned long long) timer.second.calls, 1e6 * timer.second.seconds / std::max<uint64_t>(1, timer.second.calls));
+      std::cout << line << timer.first << std::endl;
+  }
+  for (const auto &counter : profileCounters) {
+      std::cout << "  " << counter.first << ": " << counter.second << std::endl;
+  }
+  auto run = profileTimers.find("simulation: Simulator::Run");
+  if (run != profileTimers.end() && run->second.seconds > 0) {
+      std::cout << "  events per second: " << profileCounters["events"] / run->second.seconds << std::endl;
+  }
+}
+
+#define BCS_PROFILE_JOIN2(a, b) a##b
+#define BCS_PROFILE_JOIN(a, b) BCS_PROFILE_JOIN2(a, b)
+#define BCS_PROFILE_SCOPE(name) ProfileScope BCS_PROFILE_JOIN(profileScope, __LINE__) (name)
+#define BCS_PROFILE_COUNT(name, n) (profileCounters[name] += (n))
+#define BCS_PROFILE_REPORT() profileReport()
+#else
+#define BCS_PROFILE_SCOPE(name) ((void) 0)
+#define BCS_PROFILE_COUNT(name, n) ((void) 0)
+#define BCS_PROFILE_REPORT() ((void) 0)
+#endif
+
+#endif /* BLOCKCHAIN_PROFILE_H */
@@ -0,0 +1,310 @@
+/*
+ * Parameter sweep driver for BlockChainNetworkSim.
+ */
+
+#include "ns3/core-module.h"
+#include "BlockChainProcess.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <climits>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Runs every combination of a parameter grid as an independent
+// BlockChainNetworkSim process, keeping up to --jobs processes alive at once.
+//
+// example: ./ns3 run "scratch/BlockChainSweep --grid=averageBlockMineInterval=10|20|40;blockSize=500|1000;topology=4|5 --fixed='--endTime=200 --transactions=0' --jobs=8"
+//
+// The BCSBC application writes to the relative directory BCSBCOutput/, so each
+// run is started with its own working directory:
+//
+// BCSBCSweep/
+// |  run_0000/
+// |  |  - command.txt       // The command line used for the run
+// |  |  - stdout.txt        // stdout and stderr of the run
+// |  |  BCSBCOutput/        // The usual simulator output
+// |  run_0001/
+// |  ...
+// |  - summary.csv          // One row per run
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("BlockChainSweep");
+
+/**
+ * A single simulation in the sweep
+ */
+struct SweepRun {
+  int index; // the run number
+  std::vector<std::pair<std::string, std::string>> parameters; // grid values of this run
+  std::string directory; // the working directory of the run
+  pid_t pid = -1;
+  int exitStatus = -1;
+  double wallTime = 0;
+  std::chrono::steady_clock::time_point startTime;
+};
+
+/**
+ * Expand the grid into the cartesian product of all its values
+ *
+ * \param grid The grid, e.g. 'blockSize=500|1000;topology=4|5'
+ * \param combinations Filled with one parameter list per run
+ *
+ * \return false if the grid is malformed
+ */
+bool expandGrid (const std::string &grid,
+    std::vector<std::vector<std::pair<std::string, std::string>>> &combinations) {
+  combinations.clear();
+  combinations.emplace_back();
+
+  for (const std::string &entry : splitNonEmpty(grid, ';')) {
+      std::string::size_type equals = entry.find('=');
+      if (equals == std::string::npos || equals == 0) {
+          NS_LOG_INFO ("Grid entry '" + entry + "' must be of the form name=value1|value2");
+          return false;
+      }
+      std::string name = entry.substr(0, equals);
+      std::vector<std::string> values = splitNonEmpty(entry.substr(equals + 1), '|');
+      if (values.empty()) {
+          NS_LOG_INFO ("Grid entry '" + name + "' has no values");
+          return false;
+      }
+
+      std::vector<std::vector<std::pair<std::string, std::string>>> expanded;
+      expanded.reserve(combinations.size() * values.size());
+      for (const auto &combination : combinations) {
+          for (const std::string &value : values) {
+              expanded.push_back(combination);
+              expanded.back().emplace_back(name, value);
+          }
+      }
+      combinations.swap(expanded);
+  }
+  return true;
+}
+
+/**
+ * Fork and exec the simulator for a run inside the run's directory.
+ * The directory is emptied first so a failed run cannot be summarised
+ * from the output files of an earlier sweep.
+ *
+ * \param run The run to start
+ * \param simulator The absolute path of the simulator executable
+ * \param fixedArgs Arguments passed to every run
+ *
+ * \return false if the process could not be started
+ */
+bool startRun (SweepRun &run, const std::string &simulator, const std::vector<std::string> &fixedArgs) {
+  std::vector<std::string> args;
+  args.push_back(simulator);
+  args.insert(args.end(), fixedArgs.begin(), fixedArgs.end());
+  for (const auto &parameter : run.parameters) {
+      args.push_back("--" + parameter.first + "=" + parameter.second);
+  }
+
+  std::error_code error;
+  std::filesystem::remove_all(run.directory, error);
+  if (error) {
+      std::cerr << "Could not clear " << run.directory << ": " << error.message() << std::endl;
+      return false;
+  }
+
+  run.startTime = std::chrono::steady_clock::now();
+  run.pid = startSimulatorProcess(run.directory, args);
+  return run.pid > 0;
+}
+
+/**
+ * Summary numbers of a finished run, read from its output files
+ */
+struct RunSummary {
+  int blocksMined = 0;
+  int chainHeight = 0;
+  int transactionsCreated = 0;
+  std::string mainChainLength = "";
+  std::string staleBlocks = "";
+};
+
+/**
+ * Read the BCSBCOutput csv files of a finished run
+ *
+ * \param directory The run's working directory
+ *
+ * \return the summary of the run
+ */
+RunSummary summariseRun (const std::string &directory) {
+  RunSummary summary;
+  std::string line;
+
+  // Block Id, Previous Block Id,Creator Id,Location In Chain,...
+  std::ifstream mining (directory + "/BCSBCOutput/Mining events.csv");
+  std::getline(mining, line); // header
+  while (std::getline(mining, line)) {
+      std::vector<std::string> fields = splitNonEmpty(line, ',');
+      if (fields.size() < 4) {
+          continue;
+      }
+      summary.blocksMined++;
+      try {
+          summary.chainHeight = std::max(summary.chainHeight, std::stoi(fields[3]));
+      } catch (const std::invalid_argument& ia) {
+      }
+  }
+
+  std::ifstream transactions (directory + "/BCSBCOutput/Transaction creation events.csv");
+  std::getline(transactions, line); // header
+  while (std::getline(transactions, line)) {
+      if (!line.empty()) {
+          summary.transactionsCreated++;
+      }
+  }
+
+  // Metric,Value rows written by the simulator at the end of the run
+  std::ifstream metrics (directory + "/BCSBCOutput/Chain metrics.csv");
+  std::getline(metrics, line); // header
+  while (std::getline(metrics, line)) {
+      std::vector<std::string> fields = splitNonEmpty(line, ',');
+      if (fields.size() != 2) {
+          continue;
+      }
+      if (fields[0] == "Main chain length") {
+          summary.mainChainLength = fields[1];
+      } else if (fields[0] == "Stale blocks") {
+          summary.staleBlocks = fields[1];
+      }
+  }
+  return summary;
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+
+  std::string grid = "";
+  std::string fixed = "";
+  std::string outputDir = "BCSBCSweep";
+  std::string simulator = "";
+  int jobs = std::thread::hardware_concurrency();
+
+  cmd.AddValue("grid", "\nThe parameter grid. Parameters separated by ';', values by '|'.\nEvery combination is run.\nExample: 'averageBlockMineInterval=10|20;topology=4|5'.\nDefault: None.\n", grid);
+  cmd.AddValue("fixed", "\nArguments passed unchanged to every run. Space separated.\nExample: '--endTime=200 --transactions=0'.\nDefault: None.\n", fixed);
+  cmd.AddValue("jobs", "\nThe number of simulations to run at once.\nExample: 8.\nDefault: The number of cores.\n", jobs);
+  cmd.AddValue("outputDir", "\nThe directory the run directories and summary are written to.\nExample: 'study1'.\nDefault: 'BCSBCSweep'.\n", outputDir);
+  cmd.AddValue("simulator", "\nPath of the BlockChainNetworkSim executable.\nExample: 'build/scratch/ns3.40-BlockChainNetworkSim-default'.\nDefault: Found next to this executable.\n", simulator);
+
+  cmd.Parse (argc, argv);
+
+  LogComponentEnable ("BlockChainSweep", LOG_LEVEL_INFO);
+
+  if (jobs < 1) {
+      jobs = 1;
+  }
+  if (simulator == "") {
+      simulator = siblingExecutablePath(argv[0], "BlockChainSweep", "BlockChainNetworkSim");
+  }
+  if (simulator == "" || access(simulator.c_str(), X_OK) != 0) {
+      NS_LOG_INFO ("Could not find the BlockChainNetworkSim executable, specify it with --simulator");
+      return 1;
+  }
+  char resolved[PATH_MAX];
+  if (realpath(simulator.c_str(), resolved) != nullptr) {
+      simulator = resolved; // runs change directory before exec
+  }
+
+  std::vector<std::vector<std::pair<std::string, std::string>>> combinations;
+  if (!expandGrid(grid, combinations)) {
+      return 1;
+  }
+  std::vector<std::string> fixedArgs = splitNonEmpty(fixed, ' ');
+
+  std::vector<SweepRun> runs (combinations.size());
+  int numberOfRuns = (int) runs.size();
+  int r = 0;
+  while (r < numberOfRuns) {
+      char name[32];
+      snprintf(name, sizeof(name), "/run_%04d", r);
+      runs[r].index = r;
+      runs[r].parameters = combinations[r];
+      runs[r].directory = outputDir + name;
+      r++;
+  }
+
+  std::cout << "Running " << runs.size() << " simulations with " << jobs << " jobs" << std::endl;
+
+  std::map<pid_t, int> running; // pid to run index
+  int next = 0;
+  int finished = 0;
+  int failed = 0;
+  while (finished < numberOfRuns) {
+      while ((int) running.size() < jobs && next < numberOfRuns) {
+          if (!startRun(runs[next], simulator, fixedArgs)) {
+              NS_LOG_INFO ("Could not start run " + std::to_string(next));
+              runs[next].exitStatus = -1;
+              finished++;
+              failed++;
+          } else {
+              running[runs[next].pid] = next;
+          }
+          next++;
+      }
+      if (running.empty()) {
+          continue;
+      }
+
+      int status = 0;
+      pid_t pid = waitpid(-1, &status, 0);
+      if (pid < 0) {
+          break;
+      }
+      auto it = running.find(pid);
+      if (it == running.end()) {
+          continue;
+      }
+      SweepRun &run = runs[it->second];
+      running.erase(it);
+      run.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - run.startTime).count();
+      run.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+      if (run.exitStatus != 0) {
+          failed++;
+      }
+      finished++;
+      std::cout << "[" << finished << "/" << runs.size() << "] run " << run.index
+                << " exited with " << run.exitStatus << " after " << run.wallTime << "s" << std::endl;
+  }
+
+  // Merge the runs into one table
+  std::ofstream summaryFile (outputDir + "/summary.csv");
+  summaryFile << "Run";
+  if (!runs.empty()) {
+      for (const auto &parameter : runs[0].parameters) {
+          summaryFile << "," << parameter.first;
+      }
+  }
+  summaryFile << ",Exit status,Wall time (s),Blocks mined,Chain height,Main chain length,Stale blocks,Transactions created\n";
+  for (const SweepRun &run : runs) {
+      RunSummary summary = summariseRun(run.directory);
+      summaryFile << run.index;
+      for (const auto &parameter : run.parameters) {
+          summaryFile << "," << parameter.second;
+      }
+      summaryFile << "," << run.exitStatus
+                  << "," << run.wallTime
+                  << "," << summary.blocksMined
+                  << "," << summary.chainHeight
+                  << "," << summary.mainChainLength
+                  << "," << summary.staleBlocks
+                  << "," << summary.transactionsCreated << "\n";
+  }
+  summaryFile.close();
+
+  std::cout << "Sweep complete, " << failed << " of " << runs.size() << " runs failed" << std::endl;
+  std::cout << "Summary written to " << outputDir << "/summary.csv" << std::endl;
+
+  return failed == 0 ? 0 : 1;
+}